@@ -0,0 +1,409 @@
+/* -*-mode:c; c-basic-offset: 2-*- */
+/* polyspring benchmark: iterations to convergence, triangulation counts, and per-phase wall times on synthetic and reference corpora,
+   results as JSON for comparing builds
+
+   build with cmake (see ../CMakeLists.txt), or:
+   c++ -std=c++17 -O3 -march=native -pthread -I .. polyspring-bench.cpp -o polyspring-bench
+
+   polyspring-bench [options]
+     --sizes 1k,10k,100k	sizes of synthetic corpora (k and M suffixes), up to 2M
+     --corpora uniform,clustered,collinear,duplicates,truth
+     --data dir		directory of truth-*.txt reference corpora (default: test-data of the source tree)
+     --max-iter n		stop unconverged runs after n iterations (default 2000)
+     --max-seconds s		stop unconverged runs after s seconds (default 60)
+     --threads n		number of threads, 0 = hardware concurrency (default 1)
+     --integrator euler|momentum|fire
+     --incremental		repair triangulation by edge flips
+     --multilevel n		multilevel solver with coarsest level of n points
+     --reorder n		spatial reordering of points from n points on, 0 = never (default 32768)
+     --label text		label stored in the JSON output to tell builds apart
+     --out file		write JSON to file instead of stdout
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#ifndef POLYSPRING_STATS
+#define POLYSPRING_STATS	// per-part timings and counts of each iteration
+#endif
+#include "polyspring-io.hpp"
+
+#ifndef POLYSPRING_TEST_DATA
+#define POLYSPRING_TEST_DATA "../test-data"
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+  std::vector<int>	    sizes = { 1000, 10000, 100000 };
+  std::vector<std::string> corpora = { "uniform", "clustered", "collinear", "duplicates", "truth" };
+  std::string data = POLYSPRING_TEST_DATA;
+  int	      max_iter = 2000;
+  double      max_seconds = 60;
+  int	      threads = 1;
+  std::string integrator = "euler";
+  bool	      incremental = false;
+  int	      multilevel = 0;
+  int	      reorder = 1 << 15;
+  std::string label;
+  std::string out;
+};
+
+struct Corpus
+{
+  std::string	     name;
+  std::vector<float> data;	// rows of width floats
+  int		     numpoints, width, colx, coly;
+};
+
+struct Result
+{
+  std::string name;
+  int	 numpoints = 0;
+  int	 iterations = 0;
+  bool	 converged = false;
+  double max_move = 0;
+  int	 triangulations = 0;	// updates of the triangulation, full or incremental
+  int	 full_triangulations = 0;
+  double setup_ms = 0;		// set_points()
+  double total_ms = 0;		// set_points() and all iterations
+  std::vector<double> phase_ms[Polyspring<float>::NUM_PHASES];	// wall time of each call of iterate_phase() per phase ("repair" is only the
+								// incremental repair or the start of a full triangulation, "triangulate" in parts_ms all of it)
+  std::vector<double> iteration_ms;	// wall time of each complete iteration
+  double part_ms[IterationStats::NUM_TIMERS] = { 0 };	// total time per part of the iteration from Polyspring's stats
+  int	 flips = 0;		// by incremental triangulation repair
+  double first_energy = 0, last_energy = 0;
+  int	 forced_edges = 0, pushed_back = 0;	// in last iteration
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// corpora
+
+static Corpus make_uniform (int n, std::mt19937 &random)
+{
+  std::uniform_real_distribution<float> u;
+  Corpus c { "uniform", std::vector<float>(n * 2), n, 2, 0, 1 };
+  for (float &v : c.data)
+    v = u(random);
+  return c;
+}
+
+// gaussian clusters of different size and spread
+static Corpus make_clustered (int n, std::mt19937 &random)
+{
+  std::uniform_real_distribution<float> u;
+  std::normal_distribution<float> g;
+  Corpus c { "clustered", std::vector<float>(n * 2), n, 2, 0, 1 };
+  const int numclusters = 16;
+  float cx[numclusters], cy[numclusters], sigma[numclusters];
+
+  for (int k = 0; k < numclusters; k++)
+  {
+    cx[k] = u(random);
+    cy[k] = u(random);
+    sigma[k] = 0.005 + 0.1 * u(random) * u(random);
+  }
+  for (int i = 0; i < n; i++)
+  {
+    int k = std::min((int) (u(random) * u(random) * numclusters), numclusters - 1); // skewed cluster sizes
+    c.data[i * 2]     = cx[k] + sigma[k] * g(random);
+    c.data[i * 2 + 1] = cy[k] + sigma[k] * g(random);
+  }
+  return c;
+}
+
+// one column used for x and y (colx == coly)
+static Corpus make_collinear (int n, std::mt19937 &random)
+{
+  std::uniform_real_distribution<float> u;
+  Corpus c { "collinear", std::vector<float>(n), n, 1, 0, 0 };
+  for (float &v : c.data)
+    v = u(random);
+  return c;
+}
+
+// coordinates snapped to a coarse lattice, about 64 points per lattice site
+static Corpus make_duplicates (int n, std::mt19937 &random)
+{
+  std::uniform_real_distribution<float> u;
+  Corpus c { "duplicates", std::vector<float>(n * 2), n, 2, 0, 1 };
+  float levels = std::max(2, (int) std::sqrt(n / 64.));
+  for (float &v : c.data)
+    v = std::floor(u(random) * levels) / levels;
+  return c;
+}
+
+// reference corpus: columns timetag, original x, original y, final x, final y
+static bool load_truth (const std::string &filename, Corpus &c)
+{
+  ThreadPool	    pool;
+  TextCorpus<float> text;
+  pool.set_num_threads(0);
+  if (!text.load(filename, pool)  ||  text.numcols_ != 5)
+    return false;
+
+  for (auto &rows : text.chunks_)	// the runs take one buffer
+    c.data.insert(c.data.end(), rows.begin(), rows.end());
+  c.name = filename.substr(filename.find_last_of('/') + 1);
+  c.width = 5;
+  c.colx = 1;
+  c.coly = 2;
+  c.numpoints = c.data.size() / 5;
+  return c.numpoints > 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// run
+
+template<typename IntegratorT>
+static Result run (const Corpus &corpus, const Options &opt)
+{
+  Polyspring<float, Region<float>, MapDensity<float>, IntegratorT> poly;
+  std::vector<float> data = corpus.data;	// set_points() doesn't write, but takes non-const buffers
+  float *buffers[1] = { data.data() };
+  int    numpoints = corpus.numpoints;
+  Result res;
+  res.name	= corpus.name;
+  res.numpoints = numpoints;
+
+  poly.set_num_threads(opt.threads);
+  poly.set_incremental_triangulation(opt.incremental);
+  if (opt.multilevel > 0)
+    poly.set_multilevel(opt.multilevel);
+  poly.set_spatial_order(opt.reorder);
+
+  Clock::time_point start = Clock::now();
+  poly.set_points(numpoints, 1, &numpoints, buffers, corpus.width, corpus.colx, corpus.coly);
+  Clock::time_point now = Clock::now(), iter_start = now;
+  res.setup_ms = std::chrono::duration<double, std::milli>(now - start).count();
+
+  bool keep_going = true;
+  res.full_triangulations = 0;
+  while (keep_going  &&  poly.get_count() < opt.max_iter  &&  std::chrono::duration<double>(now - start).count() < opt.max_seconds)
+  {
+    int  phase = poly.phase_;
+    bool done  = poly.iterate_phase(std::numeric_limits<size_t>::max(), keep_going);
+    Clock::time_point prev = now;
+
+    now = Clock::now();
+    res.phase_ms[phase].push_back(std::chrono::duration<double, std::milli>(now - prev).count());
+    if (phase == poly.PHASE_INSERT  &&  poly.phase_ != poly.PHASE_INSERT)
+      res.full_triangulations++;
+    if (done)
+    {
+      const IterationStats &stats = poly.get_stats();
+
+      res.iteration_ms.push_back(std::chrono::duration<double, std::milli>(now - iter_start).count());
+      iter_start = now;
+      for (int t = 0; t < IterationStats::NUM_TIMERS; t++)
+	res.part_ms[t] += stats.time[t] * 1000;
+      res.flips += stats.flips;
+      if (stats.iteration == 1)
+	res.first_energy = stats.energy;
+      res.last_energy  = stats.energy;
+      res.forced_edges = stats.forced_edges;
+      res.pushed_back  = stats.pushed_back;
+    }
+  }
+
+  res.total_ms       = std::chrono::duration<double, std::milli>(now - start).count();
+  res.iterations     = poly.get_count();
+  res.converged      = poly.get_progress().converged;
+  res.max_move       = poly.get_progress().max_move;
+  res.triangulations = poly.get_triangulation_count();
+  return res;
+}
+
+static Result run (const Corpus &corpus, const Options &opt)
+{
+  if (opt.integrator == "momentum")
+    return run<MomentumIntegrator<float>>(corpus, opt);
+  else if (opt.integrator == "fire")
+    return run<FireIntegrator<float>>(corpus, opt);
+  else
+    return run<EulerIntegrator<float>>(corpus, opt);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// output
+
+static double percentile (std::vector<double> v, double p)
+{
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t) (p / 100 * v.size()))];
+}
+
+static void write_timings (FILE *out, const char *name, const std::vector<double> &v, bool last)
+{
+  double total = 0;
+  for (double t : v)
+    total += t;
+  fprintf(out, "        \"%s\": { \"calls\": %zu, \"total_ms\": %.3f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f }%s\n",
+	  name, v.size(), total, percentile(v, 50), percentile(v, 90), percentile(v, 99), percentile(v, 100), last ? "" : ",");
+}
+
+static void write_json (FILE *out, const Options &opt, const std::vector<Result> &results)
+{
+  fprintf(out, "{\n  \"label\": \"%s\",\n  \"threads\": %d,\n  \"integrator\": \"%s\",\n  \"incremental\": %s,\n  \"multilevel\": %d,\n  \"reorder\": %d,\n  \"max_iter\": %d,\n  \"results\": [\n",
+	  opt.label.c_str(), opt.threads, opt.integrator.c_str(), opt.incremental ? "true" : "false", opt.multilevel, opt.reorder, opt.max_iter);
+
+  for (size_t r = 0; r < results.size(); r++)
+  {
+    const Result &res = results[r];
+    fprintf(out, "    {\n      \"corpus\": \"%s\", \"points\": %d, \"iterations\": %d, \"converged\": %s, \"max_move\": %.6f,\n",
+	    res.name.c_str(), res.numpoints, res.iterations, res.converged ? "true" : "false", res.max_move);
+    fprintf(out, "      \"triangulations\": %d, \"full_triangulations\": %d, \"setup_ms\": %.3f, \"total_ms\": %.3f,\n",
+	    res.triangulations, res.full_triangulations, res.setup_ms, res.total_ms);
+    fprintf(out, "      \"flips\": %d, \"first_energy\": %.6f, \"last_energy\": %.6f, \"forced_edges\": %d, \"pushed_back\": %d,\n",
+	    res.flips, res.first_energy, res.last_energy, res.forced_edges, res.pushed_back);
+    fprintf(out, "      \"parts_ms\": {");
+    for (int t = 0; t < IterationStats::NUM_TIMERS; t++)
+      fprintf(out, "%s \"%s\": %.3f", t ? "," : "", IterationStats::timer_name(t), res.part_ms[t]);
+    fprintf(out, " },\n");
+    fprintf(out, "      \"phases\": {\n");
+    for (int p = 0; p < Polyspring<float>::NUM_PHASES; p++)
+      write_timings(out, Polyspring<float>::phase_name(p), res.phase_ms[p], false);
+    write_timings(out, "iteration", res.iteration_ms, true);
+    fprintf(out, "      }\n    }%s\n", r + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+static std::vector<std::string> split (const char *list)
+{
+  std::vector<std::string> items;
+  std::string item;
+  for (const char *c = list; ; c++)
+    if (*c == ','  ||  *c == 0)
+    {
+      if (!item.empty())
+	items.push_back(item);
+      item.clear();
+      if (*c == 0)
+	return items;
+    }
+    else
+      item += *c;
+}
+
+static int parse_size (const std::string &s)
+{
+  double n = atof(s.c_str());
+  if (s.back() == 'k'  ||  s.back() == 'K')
+    n *= 1000;
+  else if (s.back() == 'm'  ||  s.back() == 'M')
+    n *= 1000000;
+  return (int) n;
+}
+
+int main (int argc, char *argv[])
+{
+  Options opt;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    const char *val = i + 1 < argc  ?  argv[i + 1]  :  NULL;
+
+    if (arg == "--incremental")
+    {
+      opt.incremental = true;
+      continue;
+    }
+    if (!val)
+    {
+      fprintf(stderr, "usage: %s [--sizes 1k,10k,...] [--corpora list] [--data dir] [--max-iter n] [--max-seconds s] [--threads n]\n"
+	      "       [--integrator euler|momentum|fire] [--incremental] [--multilevel n] [--reorder n] [--label text] [--out file]\n", argv[0]);
+      return 1;
+    }
+    i++;
+    if (arg == "--sizes")
+    {
+      opt.sizes.clear();
+      for (auto &s : split(val))
+	opt.sizes.push_back(parse_size(s));
+    }
+    else if (arg == "--corpora")	opt.corpora = split(val);
+    else if (arg == "--data")		opt.data = val;
+    else if (arg == "--max-iter")	opt.max_iter = atoi(val);
+    else if (arg == "--max-seconds")	opt.max_seconds = atof(val);
+    else if (arg == "--threads")	opt.threads = atoi(val);
+    else if (arg == "--integrator")	opt.integrator = val;
+    else if (arg == "--multilevel")	opt.multilevel = atoi(val);
+    else if (arg == "--reorder")	opt.reorder = parse_size(val);
+    else if (arg == "--label")		opt.label = val;
+    else if (arg == "--out")		opt.out = val;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg.c_str());
+      return 1;
+    }
+  }
+
+  std::vector<Result> results;
+  for (auto &name : opt.corpora)
+  {
+    std::vector<Corpus> corpora;
+
+    if (name == "truth")
+    {
+      for (int k = 1; ; k++)
+      {
+	Corpus c;
+	if (!load_truth(opt.data + "/truth-" + std::to_string(k) + ".txt", c))
+	  break;
+	corpora.push_back(std::move(c));
+      }
+      if (corpora.empty())
+	fprintf(stderr, "no truth-*.txt in %s\n", opt.data.c_str());
+    }
+    else
+      for (int n : opt.sizes)
+      {
+	std::mt19937 random(n);	// same corpus for same size in every build
+	if (name == "uniform")		corpora.push_back(make_uniform(n, random));
+	else if (name == "clustered")	corpora.push_back(make_clustered(n, random));
+	else if (name == "collinear")	corpora.push_back(make_collinear(n, random));
+	else if (name == "duplicates")	corpora.push_back(make_duplicates(n, random));
+	else
+	{
+	  fprintf(stderr, "unknown corpus %s\n", name.c_str());
+	  return 1;
+	}
+      }
+
+    for (auto &corpus : corpora)
+    {
+      results.push_back(run(corpus, opt));
+      const Result &res = results.back();
+      fprintf(stderr, "%-12s %8d points: %5d iterations %s, %5d triangulations (%d full), %10.1f ms\n", res.name.c_str(), res.numpoints,
+	      res.iterations, res.converged ? "converged" : "         ", res.triangulations, res.full_triangulations, res.total_ms);
+    }
+  }
+
+  FILE *out = opt.out.empty()  ?  stdout  :  fopen(opt.out.c_str(), "w");
+  if (!out)
+  {
+    fprintf(stderr, "can't write %s\n", opt.out.c_str());
+    return 1;
+  }
+  write_json(out, opt, results);
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
@@ -0,0 +1,659 @@
+/* -*-mode:c; c-basic-offset: 2-*- */
+
+/* Persistent delaunay triangulator for polyspring
+
+   Port of the sweep-hull algorithm of delaunator-cpp (MIT License, https://github.com/delfrrr/delaunator-cpp),
+   itself a port of https://github.com/mapbox/delaunator,
+   with the same output (triangles, halfedges, hull), but keeping all internal buffers between calls,
+   such that retriangulating the same number of points does not allocate memory.
+
+   The triangulator reads the input in its own coordinate type (e.g. float, without a converted copy),
+   and decides with adaptive predicates: evaluated in double with a static error bound,
+   recomputed exactly with floating-point expansions (Shewchuk, "Adaptive Precision Floating-Point Arithmetic
+   and Fast Robust Geometric Predicates", 1997) only when the sign is uncertain.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+
+constexpr size_t INVALID_INDEX = std::numeric_limits<size_t>::max();
+
+
+// exact arithmetic on expansions: sums of non-overlapping doubles ordered by increasing magnitude,
+// functions return the number of components, zero components are eliminated
+
+// error-free transformations: s + e == a + b, p + e == a * b exactly
+inline void two_sum (double a, double b, double &s, double &e)
+{
+  s = a + b;
+  double bv = s - a, av = s - bv;
+  e = (a - av) + (b - bv);
+}
+
+inline void fast_two_sum (double a, double b, double &s, double &e) // |a| >= |b|
+{
+  s = a + b;
+  e = b - (s - a);
+}
+
+inline void two_product (double a, double b, double &p, double &e)
+{
+  p = a * b;
+  e = std::fma(a, b, -p);
+}
+
+inline int expansion_diff (double a, double b, double *h) // a - b
+{
+  double s, e;
+  two_sum(a, -b, s, e);
+  int n = 0;
+  if (e != 0)
+    h[n++] = e;
+  if (s != 0  ||  n == 0)
+    h[n++] = s;
+  return n;
+}
+
+inline int expansion_scale (const double *e, int ne, double b, double *h) // e * b, up to 2 * ne components
+{
+  double q, hh, p1, p0, sum;
+  int n = 0;
+
+  two_product(e[0], b, q, hh);
+  if (hh != 0)
+    h[n++] = hh;
+  for (int i = 1; i < ne; i++)
+  {
+    two_product(e[i], b, p1, p0);
+    two_sum(q, p0, sum, hh);
+    if (hh != 0)
+      h[n++] = hh;
+    fast_two_sum(p1, sum, q, hh);
+    if (hh != 0)
+      h[n++] = hh;
+  }
+  if (q != 0  ||  n == 0)
+    h[n++] = q;
+  return n;
+}
+
+inline int expansion_sum (const double *e, int ne, const double *f, int nf, double *h) // e + f, up to ne + nf components
+{
+  // merge components by magnitude and accumulate
+  int i = 0, j = 0, n = 0;
+  double q, qnew, hh;
+
+  if ((f[0] > e[0]) == (f[0] > -e[0]))
+    q = e[i++];
+  else
+    q = f[j++];
+  if (i < ne  &&  j < nf)
+  {
+    if ((f[j] > e[i]) == (f[j] > -e[i]))
+      fast_two_sum(e[i++], q, qnew, hh);
+    else
+      fast_two_sum(f[j++], q, qnew, hh);
+    q = qnew;
+    if (hh != 0)
+      h[n++] = hh;
+    while (i < ne  &&  j < nf)
+    {
+      if ((f[j] > e[i]) == (f[j] > -e[i]))
+	two_sum(q, e[i++], qnew, hh);
+      else
+	two_sum(q, f[j++], qnew, hh);
+      q = qnew;
+      if (hh != 0)
+	h[n++] = hh;
+    }
+  }
+  for (; i < ne; i++)
+  {
+    two_sum(q, e[i], qnew, hh);
+    q = qnew;
+    if (hh != 0)
+      h[n++] = hh;
+  }
+  for (; j < nf; j++)
+  {
+    two_sum(q, f[j], qnew, hh);
+    q = qnew;
+    if (hh != 0)
+      h[n++] = hh;
+  }
+  if (q != 0  ||  n == 0)
+    h[n++] = q;
+  return n;
+}
+
+// e * f, up to 2 * ne * nf components, scratch needs 2 * ne * (nf + 1) elements
+inline int expansion_product (const double *e, int ne, const double *f, int nf, double *h, double *scratch)
+{
+  double *part = scratch, *acc = scratch + 2 * ne;
+  int n = expansion_scale(e, ne, f[0], h);
+
+  for (int j = 1; j < nf; j++)
+  {
+    int np = expansion_scale(e, ne, f[j], part);
+    std::copy(h, h + n, acc);
+    n = expansion_sum(acc, n, part, np, h);
+  }
+  return n;
+}
+
+// exact determinants, return the largest component (which has the sign of the exact value)
+inline double orient2d_exact (double ax, double ay, double bx, double by, double cx, double cy)
+{
+  double u[2], v[2], w[2], z[2], l[8], r[8], d[16], scratch[12];
+  int nu = expansion_diff(bx, ax, u), nv = expansion_diff(cy, ay, v);
+  int nw = expansion_diff(by, ay, w), nz = expansion_diff(cx, ax, z);
+  int nl = expansion_product(u, nu, v, nv, l, scratch);
+  int nr = expansion_product(w, nw, z, nz, r, scratch);
+
+  for (int i = 0; i < nr; i++)
+    r[i] = -r[i];
+  int nd = expansion_sum(l, nl, r, nr, d);
+  return d[nd - 1];
+}
+
+inline double incircle_exact (double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+{
+  double d[6][2];		// dx, dy, ex, ey, fx, fy: coordinates relative to p
+  int	 nd[6];
+  double sq1[8], sq2[8], lift[3][16];	// ap, bp, cp
+  int	 nlift[3];
+  double m1[8], m2[8], cross[16], t[512], sum1[512], sum2[1024], det[1536];
+  double scratch[2 * 16 * 17];
+
+  nd[0] = expansion_diff(ax, px, d[0]);  nd[1] = expansion_diff(ay, py, d[1]);
+  nd[2] = expansion_diff(bx, px, d[2]);  nd[3] = expansion_diff(by, py, d[3]);
+  nd[4] = expansion_diff(cx, px, d[4]);  nd[5] = expansion_diff(cy, py, d[5]);
+
+  for (int k = 0; k < 3; k++)
+  {
+    int n1 = expansion_product(d[2 * k], nd[2 * k], d[2 * k], nd[2 * k], sq1, scratch);
+    int n2 = expansion_product(d[2 * k + 1], nd[2 * k + 1], d[2 * k + 1], nd[2 * k + 1], sq2, scratch);
+    nlift[k] = expansion_sum(sq1, n1, sq2, n2, lift[k]);
+  }
+
+  // det = ap * (ex * fy - ey * fx) + bp * (fx * dy - fy * dx) + cp * (dx * ey - dy * ex)
+  int nsum = 0;
+  double *acc = sum1;
+  for (int k = 0; k < 3; k++)
+  {
+    int i = 2 * ((k + 1) % 3), j = 2 * ((k + 2) % 3);
+    int n1 = expansion_product(d[i], nd[i], d[j + 1], nd[j + 1], m1, scratch);
+    int n2 = expansion_product(d[i + 1], nd[i + 1], d[j], nd[j], m2, scratch);
+    for (int c = 0; c < n2; c++)
+      m2[c] = -m2[c];
+    int nc = expansion_sum(m1, n1, m2, n2, cross);
+    int nt = expansion_product(lift[k], nlift[k], cross, nc, t, scratch);
+    if (k == 0)
+    {
+      std::copy(t, t + nt, sum1);
+      nsum = nt;
+    }
+    else
+    {
+      double *out = (k == 1)  ?  sum2  :  det;
+      nsum = expansion_sum(acc, nsum, t, nt, out);
+      acc = out;
+    }
+  }
+  return acc[nsum - 1];
+}
+
+// static error bounds for evaluation in double (Shewchuk's stage A)
+constexpr double PREDICATE_EPS	    = std::numeric_limits<double>::epsilon() / 2;
+constexpr double ORIENT_ERRBOUND    = (3 + 16 * PREDICATE_EPS) * PREDICATE_EPS;
+constexpr double INCIRCLE_ERRBOUND  = (10 + 96 * PREDICATE_EPS) * PREDICATE_EPS;
+
+// orient2d > 0 if a, b, c are in counter-clockwise order (delaunator's triangles are clockwise, so < 0)
+// the sign is exact, the value approximates twice the signed area
+inline double orient2d (double ax, double ay, double bx, double by, double cx, double cy)
+{
+  double l = (bx - ax) * (cy - ay), r = (by - ay) * (cx - ax);
+  double det = l - r;
+
+  if (std::fabs(det) > ORIENT_ERRBOUND * (std::fabs(l) + std::fabs(r)))
+    return det;
+  return orient2d_exact(ax, ay, bx, by, cx, cy);
+}
+
+// incircle < 0 if p is inside the circumcircle of clockwise triangle a, b, c, exact sign
+inline double incircle (double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+{
+  double dx = ax - px, dy = ay - py;
+  double ex = bx - px, ey = by - py;
+  double fx = cx - px, fy = cy - py;
+  double efl = ex * fy, efr = ey * fx;
+  double fdl = fx * dy, fdr = fy * dx;
+  double del = dx * ey, der = dy * ex;
+  double ap = dx * dx + dy * dy;
+  double bp = ex * ex + ey * ey;
+  double cp = fx * fx + fy * fy;
+  double det = ap * (efl - efr) + bp * (fdl - fdr) + cp * (del - der);
+  double permanent = ap * (std::fabs(efl) + std::fabs(efr)) + bp * (std::fabs(fdl) + std::fabs(fdr)) + cp * (std::fabs(del) + std::fabs(der));
+
+  if (std::fabs(det) > INCIRCLE_ERRBOUND * permanent)
+    return det;
+  return incircle_exact(ax, ay, bx, by, cx, cy, px, py);
+}
+
+
+// CoordT is the type of the input coordinates, read in place and promoted to double for all computations
+template<typename CoordT = double>
+class DelaunayTriangulator
+{
+public:
+  std::vector<size_t> triangles_;	// interleaved triplets of vertex indices, clockwise
+  std::vector<size_t> halfedges_;	// opposite half-edge of each half-edge, INVALID_INDEX on hull
+  std::vector<size_t> hull_prev_;	// hull as doubly linked list of point indices
+  std::vector<size_t> hull_next_;
+  std::vector<size_t> hull_tri_;	// hull edge's triangle
+  size_t	      hull_start_ = 0;
+
+private:
+  const CoordT	      *coords_ = NULL;	// interleaved x/y of current input
+  std::vector<size_t> ids_;		// point indices sorted by distance from seed circumcenter
+  std::vector<size_t> hash_;		// angular hash of hull points
+  std::vector<size_t> edge_stack_;
+  double	      center_x_ = 0, center_y_ = 0;
+  size_t	      hash_size_ = 0;
+
+  // state of resumable point insertion
+  size_t	      n_ = 0, k_ = 0;		// number of points, next index into ids_
+  size_t	      i0_ = 0, i1_ = 0, i2_ = 0;	// seed triangle
+  double	      xp_ = 0, yp_ = 0;		// previously inserted point
+
+  static double dist (double ax, double ay, double bx, double by)
+  {
+    double dx = ax - bx, dy = ay - by;
+    return dx * dx + dy * dy;
+  }
+
+  static double circumradius (double ax, double ay, double bx, double by, double cx, double cy)
+  {
+    double dx = bx - ax, dy = by - ay;
+    double ex = cx - ax, ey = cy - ay;
+    double bl = dx * dx + dy * dy;
+    double cl = ex * ex + ey * ey;
+    double d  = dx * ey - dy * ex;
+    double x  = (ey * bl - dy * cl) * 0.5 / d;
+    double y  = (dx * cl - ex * bl) * 0.5 / d;
+
+    if (bl != 0  &&  cl != 0  &&  d != 0)
+      return x * x + y * y;
+    else
+      return std::numeric_limits<double>::max();
+  }
+
+  static void circumcenter (double ax, double ay, double bx, double by, double cx, double cy, double &x, double &y)
+  {
+    double dx = bx - ax, dy = by - ay;
+    double ex = cx - ax, ey = cy - ay;
+    double bl = dx * dx + dy * dy;
+    double cl = ex * ex + ey * ey;
+    double d  = dx * ey - dy * ex;
+
+    x = ax + (ey * bl - dy * cl) * 0.5 / d;
+    y = ay + (dx * cl - ex * bl) * 0.5 / d;
+  }
+
+  // true if r is to the right of p->q (counter-clockwise in delaunator's convention)
+  static bool orient (double px, double py, double qx, double qy, double rx, double ry)
+  {
+    return orient2d(px, py, qx, qy, rx, ry) > 0;
+  }
+
+  static bool in_circle (double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+  {
+    return incircle(ax, ay, bx, by, cx, cy, px, py) < 0;
+  }
+
+  static bool equal (double x1, double y1, double x2, double y2)
+  {
+    const double eps = std::numeric_limits<double>::epsilon();
+    return std::fabs(x1 - x2) <= eps  &&  std::fabs(y1 - y2) <= eps;
+  }
+
+  // monotonically increases with real angle, but doesn't need expensive trigonometry
+  static double pseudo_angle (double dx, double dy)
+  {
+    double p = dx / (std::fabs(dx) + std::fabs(dy));
+    return (dy > 0 ? 3 - p : 1 + p) / 4;
+  }
+
+  double px (size_t i) const { return (double) coords_[2 * i]; }
+  double py (size_t i) const { return (double) coords_[2 * i + 1]; }
+
+  size_t hash_key (double x, double y) const
+  {
+    size_t key = (size_t) std::llround(std::floor(pseudo_angle(x - center_x_, y - center_y_) * (double) hash_size_));
+    return key % hash_size_;
+  }
+
+  void link (size_t a, size_t b)
+  {
+    halfedges_[a] = b;
+    if (b != INVALID_INDEX)
+      halfedges_[b] = a;
+  }
+
+  // add triangle with vertices i0, i1, i2 and opposite half-edges a, b, c
+  size_t add_triangle (size_t i0, size_t i1, size_t i2, size_t a, size_t b, size_t c)
+  {
+    size_t t = triangles_.size();
+
+    triangles_.push_back(i0);
+    triangles_.push_back(i1);
+    triangles_.push_back(i2);
+    halfedges_.resize(t + 3); // within reserved capacity
+    link(t, a);
+    link(t + 1, b);
+    link(t + 2, c);
+    return t;
+  }
+
+  // recursively flip edges until delaunay condition is fulfilled
+  size_t legalize (size_t a)
+  {
+    size_t i  = 0;
+    size_t ar = 0;
+    edge_stack_.clear();
+
+    while (true)
+    {
+      size_t b  = halfedges_[a];
+      size_t a0 = 3 * (a / 3);
+      ar = a0 + (a + 2) % 3;
+
+      if (b == INVALID_INDEX)
+      {
+	if (i == 0)
+	  break;
+	a = edge_stack_[--i];
+	continue;
+      }
+
+      size_t b0 = 3 * (b / 3);
+      size_t al = a0 + (a + 1) % 3;
+      size_t bl = b0 + (b + 2) % 3;
+      size_t p0 = triangles_[ar];
+      size_t pr = triangles_[a];
+      size_t pl = triangles_[al];
+      size_t p1 = triangles_[bl];
+
+      if (in_circle(px(p0), py(p0), px(pr), py(pr), px(pl), py(pl), px(p1), py(p1)))
+      {
+	triangles_[a] = p1;
+	triangles_[b] = p0;
+
+	size_t hbl = halfedges_[bl];
+
+	if (hbl == INVALID_INDEX)
+	{ // edge swapped on the other side of the hull (rare): fix the halfedge reference
+	  size_t e = hull_start_;
+	  do {
+	    if (hull_tri_[e] == bl)
+	    {
+	      hull_tri_[e] = a;
+	      break;
+	    }
+	    e = hull_prev_[e];
+	  } while (e != hull_start_);
+	}
+	link(a, hbl);
+	link(b, halfedges_[ar]);
+	link(ar, bl);
+
+	size_t br = b0 + (b + 1) % 3;
+	if (i < edge_stack_.size())
+	  edge_stack_[i] = br;
+	else
+	  edge_stack_.push_back(br);
+	i++;
+      }
+      else
+      {
+	if (i == 0)
+	  break;
+	a = edge_stack_[--i];
+      }
+    }
+    return ar;
+  } // end DelaunayTriangulator::legalize ()
+
+public:
+  // triangulate n points given as interleaved x/y coordinates, reusing buffers of previous calls
+  // throws std::runtime_error if all points are collinear, like delaunator
+  void triangulate (const CoordT *coords, size_t n)
+  {
+    start(coords, n);
+    insert(n);
+  }
+
+  // resumable triangulation: start() finds the seed triangle and sorts the points (coords must stay valid until finished),
+  // then each insert() adds up to count points, returns true when all points are inserted;
+  // a caller sorting the points itself calls seed(), sorts order() by sort_key() (ties by x, then y), then begin_insert() instead of start()
+  void start (const CoordT *coords, size_t n)
+  {
+    seed(coords, n);
+
+    // sort points by distance from seed triangle circumcenter
+    std::sort(ids_.begin(), ids_.end(), [&](size_t i, size_t j)
+    {
+      double d1 = sort_key(i);
+      double d2 = sort_key(j);
+      if (d1 != d2)
+	return d1 < d2;
+      else if (px(i) != px(j))
+	return px(i) < px(j);
+      else
+	return py(i) < py(j);
+    });
+    begin_insert();
+  }
+
+  double sort_key (size_t i) { return dist(px(i), py(i), center_x_, center_y_); }
+  std::vector<size_t> &order () { return ids_; }
+
+  void seed (const CoordT *coords, size_t n)
+  {
+    coords_ = coords;
+    n_ = n;
+    edge_stack_.reserve(1024); // legalize depth stays far below, no growth while iterating
+
+    double minx =  std::numeric_limits<double>::max(), miny = minx;
+    double maxx = -std::numeric_limits<double>::max(), maxy = maxx;
+
+    ids_.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+      double x = px(i), y = py(i);
+      if (x < minx)  minx = x;
+      if (y < miny)  miny = y;
+      if (x > maxx)  maxx = x;
+      if (y > maxy)  maxy = y;
+      ids_[i] = i;
+    }
+    double cx = (minx + maxx) / 2;
+    double cy = (miny + maxy) / 2;
+
+    // seed triangle: point closest to center, its nearest neighbour, and the point making the smallest circumcircle with them
+    size_t i0 = INVALID_INDEX, i1 = INVALID_INDEX, i2 = INVALID_INDEX;
+    double mindist = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < n; i++)
+    {
+      double d = dist(cx, cy, px(i), py(i));
+      if (d < mindist)
+      {
+	i0 = i;
+	mindist = d;
+      }
+    }
+    if (i0 == INVALID_INDEX)
+      throw std::runtime_error("No Delaunay triangulation exists for this input.");
+
+    mindist = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < n; i++)
+    {
+      if (i == i0)
+	continue;
+      double d = dist(px(i0), py(i0), px(i), py(i));
+      if (d < mindist  &&  d > 0)
+      {
+	i1 = i;
+	mindist = d;
+      }
+    }
+    if (i1 == INVALID_INDEX)
+      throw std::runtime_error("No Delaunay triangulation exists for this input.");
+
+    double minradius = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < n; i++)
+    {
+      if (i == i0  ||  i == i1)
+	continue;
+      double r = circumradius(px(i0), py(i0), px(i1), py(i1), px(i), py(i));
+      if (r < minradius)
+      {
+	i2 = i;
+	minradius = r;
+      }
+    }
+    if (!(minradius < std::numeric_limits<double>::max()))
+      throw std::runtime_error("No Delaunay triangulation exists for this input.");
+
+    if (orient(px(i0), py(i0), px(i1), py(i1), px(i2), py(i2)))
+      std::swap(i1, i2);
+
+    circumcenter(px(i0), py(i0), px(i1), py(i1), px(i2), py(i2), center_x_, center_y_);
+    i0_ = i0;
+    i1_ = i1;
+    i2_ = i2;
+  } // end DelaunayTriangulator::seed ()
+
+  void begin_insert ()
+  {
+    size_t n = n_, i0 = i0_, i1 = i1_, i2 = i2_;
+
+    // initialize hull and angular hash
+    hash_size_ = (size_t) std::llround(std::ceil(std::sqrt((double) n)));
+    hash_.assign(hash_size_, INVALID_INDEX);
+    hull_prev_.resize(n);
+    hull_next_.resize(n);
+    hull_tri_.resize(n);
+
+    hull_start_ = i0;
+    hull_next_[i0] = hull_prev_[i2] = i1;
+    hull_next_[i1] = hull_prev_[i0] = i2;
+    hull_next_[i2] = hull_prev_[i1] = i0;
+    hull_tri_[i0] = 0;
+    hull_tri_[i1] = 1;
+    hull_tri_[i2] = 2;
+    hash_[hash_key(px(i0), py(i0))] = i0;
+    hash_[hash_key(px(i1), py(i1))] = i1;
+    hash_[hash_key(px(i2), py(i2))] = i2;
+
+    size_t maxtriangles = n < 3  ?  1  :  2 * n - 5;
+    triangles_.clear();
+    halfedges_.clear();
+    triangles_.reserve(maxtriangles * 3); // no-op when retriangulating the same number of points
+    halfedges_.reserve(maxtriangles * 3);
+
+    add_triangle(i0, i1, i2, INVALID_INDEX, INVALID_INDEX, INVALID_INDEX);
+
+    xp_ = yp_ = std::numeric_limits<double>::quiet_NaN();
+    k_  = 0;
+  } // end DelaunayTriangulator::begin_insert ()
+
+  bool insert (size_t count)
+  {
+    size_t i0 = i0_, i1 = i1_, i2 = i2_;
+    size_t kend = std::min(n_, k_ + std::min(count, n_));
+
+    for (; k_ < kend; k_++)
+    {
+      size_t i = ids_[k_];
+      double x = px(i), y = py(i);
+
+      // skip near-duplicate points and seed triangle points
+      if (k_ > 0  &&  equal(x, y, xp_, yp_))
+	continue;
+      xp_ = x;
+      yp_ = y;
+      if (equal(x, y, px(i0), py(i0))  ||  equal(x, y, px(i1), py(i1))  ||  equal(x, y, px(i2), py(i2)))
+	continue;
+
+      // find a visible edge on the convex hull using edge hash
+      size_t start = 0;
+      size_t key   = hash_key(x, y);
+      for (size_t j = 0; j < hash_size_; j++)
+      {
+	start = hash_[(key + j) % hash_size_];
+	if (start != INVALID_INDEX  &&  start != hull_next_[start])
+	  break;
+      }
+      start = hull_prev_[start];
+
+      size_t e = start, q;
+      while (q = hull_next_[e], !orient(x, y, px(e), py(e), px(q), py(q)))
+      {
+	e = q;
+	if (e == start)
+	{ // likely a near-duplicate point, skip it
+	  e = INVALID_INDEX;
+	  break;
+	}
+      }
+      if (e == INVALID_INDEX)
+	continue;
+
+      // add the first triangle from the point
+      size_t t = add_triangle(e, i, hull_next_[e], INVALID_INDEX, INVALID_INDEX, hull_tri_[e]);
+      hull_tri_[i] = legalize(t + 2);
+      hull_tri_[e] = t;
+
+      // walk forward through the hull, adding more triangles and flipping recursively
+      size_t next = hull_next_[e];
+      while (q = hull_next_[next], orient(x, y, px(next), py(next), px(q), py(q)))
+      {
+	t = add_triangle(next, i, q, hull_tri_[i], INVALID_INDEX, hull_tri_[next]);
+	hull_tri_[i] = legalize(t + 2);
+	hull_next_[next] = next; // mark as removed
+	next = q;
+      }
+
+      // walk backward from the other side, adding more triangles and flipping
+      if (e == start)
+      {
+	while (q = hull_prev_[e], orient(x, y, px(q), py(q), px(e), py(e)))
+	{
+	  t = add_triangle(q, i, e, INVALID_INDEX, hull_tri_[e], hull_tri_[q]);
+	  legalize(t + 2);
+	  hull_tri_[q] = t;
+	  hull_next_[e] = e; // mark as removed
+	  e = q;
+	}
+      }
+
+      // update the hull indices
+      hull_prev_[i] = e;
+      hull_start_ = e;
+      hull_prev_[next] = i;
+      hull_next_[e] = i;
+      hull_next_[i] = next;
+
+      hash_[hash_key(x, y)] = i;
+      hash_[hash_key(px(e), py(e))] = e;
+    }
+    return k_ == n_;
+  } // end DelaunayTriangulator::insert ()
+}; // end class DelaunayTriangulator
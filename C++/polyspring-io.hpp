@@ -0,0 +1,630 @@
+/* -*-mode:c; c-basic-offset: 2-*- */
+
+/* File input/output for polyspring
+
+   Corpus loading without copies in front of Polyspring::set_points():
+   CorpusBlocks describes a corpus as the blocks, sizes, stride and column offsets set_points() takes.
+   TextCorpus parses whitespace or comma separated text (one row per line, e.g. test-data/truth-*.txt) in parallel
+   from a mapped file. ColumnFile maps a columnar binary file, in blocks of blockrows rows holding each column contiguously:
+
+     header      ColumnHeader
+     names       numcols * 32 chars, nul-padded column names
+     blocks      numblocks * numcols * blockrows CoordT, column c of block b at (b * numcols + c) * blockrows,
+		 the last block padded with zeros
+
+   such that each block is one set_points() buffer with stride 1 and column offsets c * blockrows.
+
+   LayoutCache: persistent cache of converged layouts in a directory, one memory-mappable file per corpus and setup.
+   The file name is made of two keys: the setup hash (region, density map, solver and integrator parameters,
+   see Polyspring::get_setup_hash()) and the hash of the original point coordinates given to set_points().
+   A file holds the original points, the converged normalised layout and the triangulation,
+   in native byte order:
+
+     header      LayoutHeader
+     orig        numpoints * 2 CoordT, interleaved original coords
+     points      numpoints * 2 CoordT, interleaved normalised layout
+     triangles   numhalf int32, start vertex of each half-edge (3 per triangle)
+     halfedges   numhalf int32, opposite half-edge, -1 on the hull
+
+   On an exact hit, the layout and triangulation are restored without iterating.
+   Otherwise a near match (same setup, a corpus sharing most points, e.g. with a few points added or removed)
+   warm-starts the solver from the cached positions of the shared points.
+*/
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <charconv>	// for from_chars
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define POLYSPRING_MMAP 1
+#endif
+#include "polyspring.hpp"
+
+
+// read-only view of a whole file, memory-mapped where available, else read into memory
+class MappedFile
+{
+  const char	   *data_ = NULL;
+  size_t	    size_ = 0;
+#if POLYSPRING_MMAP
+  void		   *map_ = NULL;
+#endif
+  std::vector<char> buffer_;
+
+public:
+  MappedFile () { }
+  MappedFile (const std::string &path) { open(path); }
+  ~MappedFile () { close(); }
+  MappedFile (const MappedFile &) = delete;
+  MappedFile &operator= (const MappedFile &) = delete;
+
+  // copy_on_write: the view may be written to, which copies the touched pages (never written back to the file)
+  bool open (const std::string &path, bool copy_on_write = false)
+  {
+    close();
+#if POLYSPRING_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0  &&  st.st_size > 0)
+    {
+      void *map = mmap(NULL, st.st_size, copy_on_write  ?  PROT_READ | PROT_WRITE  :  PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+      {
+	map_  = map;
+	data_ = static_cast<const char *>(map);
+	size_ = st.st_size;
+      }
+    }
+    ::close(fd);
+    return data_ != NULL;
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      return false;
+    buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    return size_ > 0;
+#endif
+  } // end MappedFile::open ()
+
+  void close ()
+  {
+#if POLYSPRING_MMAP
+    if (map_)
+      munmap(map_, size_);
+    map_ = NULL;
+#endif
+    buffer_.clear();
+    data_ = NULL;
+    size_ = 0;
+  }
+
+  const char *data () const { return data_; }
+  char	     *writable_data () { return const_cast<char *>(data_); }	// only if opened copy_on_write
+  size_t      size () const { return size_; }
+  bool	      is_open () const { return data_ != NULL; }
+}; // end class MappedFile
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CORPUS LOADING
+
+// corpus as blocks of rows for Polyspring::set_points() or add_points(), pointing into the loader's memory
+template<typename CoordT>
+struct CorpusBlocks
+{
+  int			numtotal = 0;
+  std::vector<int>	bufsizes;
+  std::vector<CoordT *> buffers;
+  int			bufwidth = 0;	// stride between rows
+  int			colx = 0, coly = 0;	// offsets of x and y from row start
+
+  template<typename SolverT>
+  void set_points (SolverT &solver) { solver.set_points(numtotal, buffers.size(), bufsizes.data(), buffers.data(), bufwidth, colx, coly); }
+};
+
+
+// rows of numbers separated by whitespace or commas, one row per line, empty lines and lines starting with # are skipped,
+// parsed by all threads of pool on chunks of whole lines, each into its own row-major block (see blocks())
+template<typename CoordT>
+class TextCorpus
+{
+public:
+  std::vector<std::vector<CoordT>> chunks_;	// rows parsed by each thread, in file order, numcols_ values per row
+  int				   numrows_ = 0;	// in all chunks
+  int				   numcols_ = 0;
+
+  // returns false if the file can't be read, or its rows differ in length (chunks_ is then empty)
+  bool load (const std::string &path, ThreadPool &pool)
+  {
+    chunks_.clear();
+    numrows_ = numcols_ = 0;
+    MappedFile file;
+    if (!file.open(path))
+      return false;
+    const char *begin = file.data(), *end = begin + file.size();
+
+    // number of columns from the first row
+    std::vector<CoordT> first;
+    for (const char *line = begin; line < end  &&  first.empty(); )
+    {
+      const char *next = line_end(line, end);
+      if (!parse_line(line, next, first))
+	return false;
+      line = next + 1;
+    }
+    numcols_ = first.size();
+    if (numcols_ == 0)
+      return false;
+
+    // parse chunks starting after a newline into per-thread rows
+    int numthreads = pool.get_num_threads();
+    std::vector<std::vector<CoordT>> chunks(numthreads);
+    std::vector<char> ok(numthreads, 1);
+    pool.run([&](int thread, int numthreads)
+    {
+      const char *cbegin = chunk_start(begin, end, file.size() * thread / numthreads);
+      const char *cend   = chunk_start(begin, end, file.size() * (thread + 1) / numthreads);
+      std::vector<CoordT> &rows = chunks[thread];
+      for (const char *line = cbegin; line < cend; )
+      {
+	const char *next = line_end(line, cend);
+	size_t      size = rows.size();
+	if (!parse_line(line, next, rows)  ||  (rows.size() != size  &&  rows.size() != size + numcols_))
+	{
+	  ok[thread] = 0;
+	  return;
+	}
+	line = next + 1;
+      }
+    });
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end())
+      return false;
+
+    // keep the chunks as they are, set_points() takes them as separate blocks
+    for (auto &rows : chunks)
+      if (!rows.empty())
+      {
+	numrows_ += rows.size() / numcols_;
+	chunks_.push_back(std::move(rows));
+      }
+    return true;
+  } // end TextCorpus::load ()
+
+  // one block per chunk, no copy
+  CorpusBlocks<CoordT> blocks (int colx, int coly)
+  {
+    CorpusBlocks<CoordT> blocks;
+    blocks.numtotal = numrows_;
+    for (auto &rows : chunks_)
+    {
+      blocks.bufsizes.push_back(rows.size() / numcols_);
+      blocks.buffers.push_back(rows.data());
+    }
+    blocks.bufwidth = numcols_;
+    blocks.colx	    = colx;
+    blocks.coly	    = coly;
+    return blocks;
+  }
+
+private:
+  static const char *line_end (const char *line, const char *end)
+  {
+    const char *nl = static_cast<const char *>(memchr(line, '\n', end - line));
+    return nl  ?  nl  :  end;
+  }
+
+  // first line start at or after pos (which starts a line if it follows a newline)
+  static const char *chunk_start (const char *begin, const char *end, size_t pos)
+  {
+    if (pos == 0)
+      return begin;
+    if (begin + pos >= end)
+      return end;
+    return std::min(line_end(begin + pos - 1, end) + 1, end);
+  }
+
+  // append the numbers of line [line, end) to row, false on garbage
+  static bool parse_line (const char *line, const char *end, std::vector<CoordT> &row)
+  {
+    while (true)
+    {
+      while (line < end  &&  (*line == ' '  ||  *line == '\t'  ||  *line == ','  ||  *line == '\r'))
+	line++;
+      if (line == end  ||  *line == '#')
+	return true;
+
+      CoordT value;
+#if defined(__cpp_lib_to_chars)
+      if (*line == '+')	// from_chars doesn't take a plus sign
+	line++;
+      std::from_chars_result res = std::from_chars(line, end, value);
+      if (res.ec != std::errc())
+	return false;
+      line = res.ptr;
+#else // no floating-point from_chars: strtod on a terminated copy
+      char  token[64];
+      char *tend;
+      size_t len = std::min<size_t>(end - line, sizeof(token) - 1);
+      memcpy(token, line, len);
+      token[len] = 0;
+      value = strtod(token, &tend);
+      if (tend == token)
+	return false;
+      line += tend - token;
+#endif
+      row.push_back(value);
+    }
+  } // end TextCorpus::parse_line ()
+}; // end class TextCorpus
+
+
+// columnar binary corpus, mapped copy-on-write such that its blocks go to set_points() as they are
+template<typename CoordT>
+class ColumnFile
+{
+public:
+  struct ColumnHeader
+  {
+    char     magic[8];		// "PSCOLUMN"
+    uint32_t version;
+    uint32_t coord_size;	// sizeof(CoordT)
+    uint64_t numrows;
+    uint32_t numcols;
+    uint32_t blockrows;		// rows per block
+    uint64_t names_offset, data_offset;	// byte offsets from the start of the file
+  };
+  static constexpr uint32_t version_ = 2;	// 2: no bounds, they follow from the original coords
+  static constexpr int	    name_size_ = 32;
+
+  bool open (const std::string &path)
+  {
+    head_ = NULL;
+    if (!file_.open(path, true)  ||  file_.size() < sizeof(ColumnHeader))
+      return false;
+    const ColumnHeader *head = reinterpret_cast<const ColumnHeader *>(file_.data());
+    uint64_t numblocks = head->blockrows > 0  ?  (head->numrows + head->blockrows - 1) / head->blockrows  :  0;
+    if (memcmp(head->magic, magic_, sizeof(head->magic)) != 0  ||  head->version != version_  ||  head->coord_size != sizeof(CoordT)
+	||  head->blockrows == 0  ||  head->numcols == 0  ||  head->numrows > (uint64_t) std::numeric_limits<int>::max()
+	||  (uint64_t) head->numcols * head->blockrows > (uint64_t) std::numeric_limits<int>::max()
+	||  head->names_offset + head->numcols * name_size_ > file_.size()
+	||  head->data_offset + numblocks * head->numcols * head->blockrows * sizeof(CoordT) > file_.size())
+      return false;
+    head_ = head;
+    return true;
+  } // end ColumnFile::open ()
+
+  int numrows () { return head_  ?  head_->numrows  :  0; }
+  int numcols () { return head_  ?  head_->numcols  :  0; }
+
+  // index of column name, -1 if there is none
+  int column (const std::string &name)
+  {
+    for (int c = 0; c < numcols(); c++)
+      if (name == std::string(file_.data() + head_->names_offset + c * name_size_, strnlen(file_.data() + head_->names_offset + c * name_size_, name_size_)))
+	return c;
+    return -1;
+  }
+
+  CorpusBlocks<CoordT> blocks (int colx, int coly)
+  {
+    CorpusBlocks<CoordT> blocks;
+    if (!head_)
+      return blocks;
+    CoordT *data = reinterpret_cast<CoordT *>(file_.writable_data() + head_->data_offset);
+    int     blocksize = head_->numcols * head_->blockrows;
+    blocks.numtotal = head_->numrows;
+    for (int row = 0; row < blocks.numtotal; row += head_->blockrows)
+    {
+      blocks.bufsizes.push_back(std::min<int>(head_->blockrows, blocks.numtotal - row));
+      blocks.buffers.push_back(data + (size_t) row / head_->blockrows * blocksize);
+    }
+    blocks.bufwidth = 1;
+    blocks.colx	    = colx * head_->blockrows;
+    blocks.coly	    = coly * head_->blockrows;
+    return blocks;
+  }
+
+  // write numrows rows of numcols values, rowstride apart in data (e.g. a TextCorpus chunk), names may be empty
+  static bool write (const std::string &path, int numrows, int numcols, const CoordT *data, int rowstride,
+		     const std::vector<std::string> &names = {}, int blockrows = 1 << 16)
+  {
+    ColumnHeader head = {};
+    memcpy(head.magic, magic_, sizeof(head.magic));
+    head.version      = version_;
+    head.coord_size   = sizeof(CoordT);
+    head.numrows      = numrows;
+    head.numcols      = numcols;
+    head.blockrows    = std::max(1, std::min(blockrows, numrows));
+    head.names_offset = sizeof(ColumnHeader);
+    head.data_offset  = (head.names_offset + numcols * name_size_ + 63) & ~uint64_t(63);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    out.write(reinterpret_cast<const char *>(&head), sizeof(head));
+    std::vector<char> namebuf(head.data_offset - head.names_offset, 0);
+    for (int c = 0; c < numcols  &&  c < (int) names.size(); c++)
+      strncpy(namebuf.data() + c * name_size_, names[c].c_str(), name_size_);
+    out.write(namebuf.data(), namebuf.size());
+
+    std::vector<CoordT> block((size_t) numcols * head.blockrows);
+    for (int row = 0; row < numrows; row += head.blockrows)
+    { // transpose rows into columns
+      int num = std::min<int>(head.blockrows, numrows - row);
+      std::fill(block.begin(), block.end(), 0);
+      for (int c = 0; c < numcols; c++)
+	for (int i = 0; i < num; i++)
+	  block[(size_t) c * head.blockrows + i] = data[(size_t) (row + i) * rowstride + c];
+      out.write(reinterpret_cast<const char *>(block.data()), block.size() * sizeof(CoordT));
+    }
+    return (bool) out;
+  } // end ColumnFile::write ()
+
+private:
+  MappedFile	      file_;
+  const ColumnHeader *head_ = NULL;
+  static constexpr const char *magic_ = "PSCOLUMN";
+}; // end class ColumnFile
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LAYOUT CACHE
+
+// converged layouts in directory dir_, one file per corpus and setup (see top)
+class LayoutCache
+{
+public:
+  enum Result { MISS, WARM, HIT };
+
+  struct LayoutHeader
+  {
+    char     magic[8];		// "PSLAYOUT"
+    uint32_t version;
+    uint32_t coord_size;	// sizeof(CoordT)
+    uint64_t key;		// hash of the original coords
+    uint64_t setup_key;		// Polyspring::get_setup_hash()
+    uint64_t numpoints;
+    uint64_t numhalf;
+    int64_t  count;		// iterations to convergence
+    uint64_t orig_offset, points_offset, triangles_offset, halfedges_offset;	// byte offsets of the sections from the start of the file
+  };
+  static constexpr uint32_t version_ = 2;	// 2: no bounds, they follow from the original coords
+
+  // near matches: at least match_ratio_ of the points must be in the cached corpus,
+  // which may have between 1 / size_ratio_ and size_ratio_ times as many points
+  double match_ratio_ = 0.75;
+  double size_ratio_  = 1.33;
+
+  LayoutCache (const std::string &dir) : dir_(dir)
+  {
+    std::error_code err;
+    std::filesystem::create_directories(dir_, err);
+  }
+
+  // call after set_points(): restore the converged layout and triangulation of the same corpus and setup (HIT),
+  // or start from the layout of a near match (WARM, iterate as usual), else leave the solver as is (MISS)
+  template<typename CoordT, typename RegionT, typename DensityT, typename IntegratorT>
+  Result load (Polyspring<CoordT, RegionT, DensityT, IntegratorT> &solver)
+  {
+    int numpoints = solver.get_num_points();
+    if (numpoints < 3)
+      return MISS;
+    std::vector<CoordT> orig(numpoints * 2);
+    solver.get_original(orig.data());
+    uint64_t key = hash_value(numpoints, hash_bytes(orig.data(), orig.size() * sizeof(CoordT)));
+    uint64_t setup = solver.get_setup_hash();
+
+    MappedFile file;
+    const LayoutHeader *head;
+    if (file.open(path(setup, key).string())  &&  (head = check<CoordT>(file, setup))  &&  head->key == key  &&  head->numpoints == (uint64_t) numpoints
+	&&  memcmp(orig.data(), file.data() + head->orig_offset, orig.size() * sizeof(CoordT)) == 0)
+    {
+      solver.set_converged_layout(reinterpret_cast<const CoordT *>(file.data() + head->points_offset), head->numhalf,
+				  reinterpret_cast<const int32_t *>(file.data() + head->triangles_offset),
+				  reinterpret_cast<const int32_t *>(file.data() + head->halfedges_offset), head->count);
+      return HIT;
+    }
+
+    // near matches, closest size first
+    std::vector<std::pair<uint64_t, std::filesystem::path>> candidates;
+    std::string prefix = hex(setup) + "-";
+    std::error_code err;
+    for (auto &entry : std::filesystem::directory_iterator(dir_, err))
+    {
+      std::string name = entry.path().filename().string();
+      if (name.compare(0, prefix.size(), prefix) != 0  ||  entry.path().extension() != extension_)
+	continue;
+      if (!file.open(entry.path().string())  ||  !(head = check<CoordT>(file, setup)))
+	continue;
+      if (head->numpoints * size_ratio_ < numpoints  ||  head->numpoints > numpoints * size_ratio_)
+	continue;
+      candidates.emplace_back(head->numpoints > (uint64_t) numpoints  ?  head->numpoints - numpoints  :  numpoints - head->numpoints, entry.path());
+    }
+    std::sort(candidates.begin(), candidates.end());
+    if (!candidates.empty())
+      sort_points(orig.data(), numpoints, order_);
+
+    for (auto &candidate : candidates)
+    {
+      if (!file.open(candidate.second.string())  ||  !(head = check<CoordT>(file, setup)))
+	continue;
+      int numcached = head->numpoints;
+      const CoordT *cached_orig = reinterpret_cast<const CoordT *>(file.data() + head->orig_offset);
+      const CoordT *cached_pts  = reinterpret_cast<const CoordT *>(file.data() + head->points_offset);
+
+      // match points with equal original coords by merging both corpora sorted by x, then y
+      sort_points(cached_orig, numcached, cached_order_);
+      std::vector<CoordT> layout(numpoints * 2, 0);
+      known_.assign(numpoints, 0);
+      int matched = 0;
+      for (int i = 0, j = 0; i < numpoints  &&  j < numcached; )
+      {
+	int a = order_[i], b = cached_order_[j];
+	if (less(orig.data(), a, cached_orig, b))
+	  i++;
+	else if (less(cached_orig, b, orig.data(), a))
+	  j++;
+	else
+	{
+	  layout[x(a)] = cached_pts[x(b)];
+	  layout[y(a)] = cached_pts[y(b)];
+	  known_[a] = 1;
+	  matched++;
+	  i++, j++;
+	}
+      }
+
+      if (matched >= match_ratio_ * numpoints)
+      {
+	solver.set_layout(layout.data(), known_.data());
+	return WARM;
+      }
+    }
+    return MISS;
+  } // end LayoutCache::load ()
+
+  // write the converged layout of solver (returns false if there is no triangulation yet)
+  template<typename CoordT, typename RegionT, typename DensityT, typename IntegratorT>
+  bool store (Polyspring<CoordT, RegionT, DensityT, IntegratorT> &solver)
+  {
+    int numpoints = solver.get_num_points();
+    if (numpoints < 3  ||  !solver.get_vertices(vertices_)  ||  !solver.get_halfedges(halfedges_))
+      return false;
+
+    std::vector<CoordT> orig(numpoints * 2), pts(numpoints * 2);
+    solver.get_original(orig.data());
+    solver.get_normalised(pts.data());
+    std::vector<int32_t> triangles(vertices_.begin(), vertices_.end()), halfedges(halfedges_.size());
+    for (size_t e = 0; e < halfedges_.size(); e++)
+      halfedges[e] = halfedges_[e] == INVALID_INDEX  ?  -1  :  (int32_t) halfedges_[e];
+
+    LayoutHeader head = {};
+    memcpy(head.magic, magic_, sizeof(head.magic));
+    head.version	   = version_;
+    head.coord_size	   = sizeof(CoordT);
+    head.key		   = hash_value(numpoints, hash_bytes(orig.data(), orig.size() * sizeof(CoordT)));
+    head.setup_key	   = solver.get_setup_hash();
+    head.numpoints	   = numpoints;
+    head.numhalf	   = triangles.size();
+    head.count		   = solver.get_count();
+    head.orig_offset	   = align(sizeof(LayoutHeader));
+    head.points_offset	   = align(head.orig_offset + orig.size() * sizeof(CoordT));
+    head.triangles_offset  = align(head.points_offset + pts.size() * sizeof(CoordT));
+    head.halfedges_offset  = align(head.triangles_offset + triangles.size() * sizeof(int32_t));
+
+    // write to a temporary file and rename, such that readers never see a partial file
+    std::filesystem::path target = path(head.setup_key, head.key), temp = target;
+    temp += ".tmp";
+    {
+      std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+      if (!out)
+	return false;
+      write_at(out, 0, &head, sizeof(head));
+      write_at(out, head.orig_offset, orig.data(), orig.size() * sizeof(CoordT));
+      write_at(out, head.points_offset, pts.data(), pts.size() * sizeof(CoordT));
+      write_at(out, head.triangles_offset, triangles.data(), triangles.size() * sizeof(int32_t));
+      write_at(out, head.halfedges_offset, halfedges.data(), halfedges.size() * sizeof(int32_t));
+      if (!out)
+	return false;
+    }
+    std::error_code err;
+    std::filesystem::rename(temp, target, err);
+    return !err;
+  } // end LayoutCache::store ()
+
+private:
+  std::filesystem::path	dir_;
+  static constexpr const char *magic_ = "PSLAYOUT";
+  static constexpr const char *extension_ = ".pslayout";
+
+  // scratch
+  std::vector<size_t>	vertices_, halfedges_;
+  std::vector<char>	known_;
+  std::vector<int>	order_, cached_order_;
+
+  static uint64_t align (uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+  static std::string hex (uint64_t h)
+  {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) h);
+    return buf;
+  }
+
+  std::filesystem::path path (uint64_t setup, uint64_t key) { return dir_ / (hex(setup) + "-" + hex(key) + extension_); }
+
+  static void write_at (std::ofstream &out, uint64_t offset, const void *data, size_t size)
+  {
+    out.seekp(offset);
+    out.write(static_cast<const char *>(data), size);
+  }
+
+  // size bytes at offset are after the header, inside file and aligned (overflow-safe, the sizes are bounded by the caller)
+  static bool section (const MappedFile &file, uint64_t offset, uint64_t size)
+  {
+    return offset >= sizeof(LayoutHeader)  &&  offset % 8 == 0  &&  offset <= file.size()  &&  size <= file.size() - offset;
+  }
+
+  // header of file if it is a complete and consistent layout file of this setup and coordinate type, else NULL
+  template<typename CoordT>
+  static const LayoutHeader *check (const MappedFile &file, uint64_t setup)
+  {
+    if (file.size() < sizeof(LayoutHeader))
+      return NULL;
+    const LayoutHeader *head = reinterpret_cast<const LayoutHeader *>(file.data());
+    if (memcmp(head->magic, magic_, sizeof(head->magic)) != 0  ||  head->version != version_  ||  head->coord_size != sizeof(CoordT)
+	||  head->setup_key != setup  ||  head->numhalf % 3 != 0  ||  head->numpoints > (uint64_t) std::numeric_limits<int>::max()
+	||  head->numhalf > file.size() / sizeof(int32_t)
+	||  !section(file, head->orig_offset,      head->numpoints * 2 * sizeof(CoordT))
+	||  !section(file, head->points_offset,    head->numpoints * 2 * sizeof(CoordT))
+	||  !section(file, head->triangles_offset, head->numhalf * sizeof(int32_t))
+	||  !section(file, head->halfedges_offset, head->numhalf * sizeof(int32_t)))
+      return NULL;
+
+    const int32_t *tri  = reinterpret_cast<const int32_t *>(file.data() + head->triangles_offset);
+    const int32_t *half = reinterpret_cast<const int32_t *>(file.data() + head->halfedges_offset);
+    for (uint64_t e = 0; e < head->numhalf; e++)
+      if (tri[e] < 0  ||  (uint64_t) tri[e] >= head->numpoints  ||  half[e] < -1  ||  half[e] >= (int64_t) head->numhalf)
+	return NULL;
+
+    // the half-edges must pair up and join the same two vertices in opposite directions: restoring a layout doesn't check the mesh again
+    for (uint64_t e = 0; e < head->numhalf; e++)
+    {
+      int64_t h = half[e];
+      if (h >= 0  &&  (half[h] != (int64_t) e  ||  tri[h] != tri[e % 3 == 2  ?  e - 2  :  e + 1]))
+	return NULL;
+    }
+    return head;
+  } // end LayoutCache::check ()
+
+  template<typename CoordT>
+  static bool less (const CoordT *p, int a, const CoordT *q, int b)
+  {
+    return p[x(a)] < q[x(b)]  ||  (p[x(a)] == q[x(b)]  &&  p[y(a)] < q[y(b)]);
+  }
+
+  // indices of num interleaved points sorted by x, then y
+  template<typename CoordT>
+  static void sort_points (const CoordT *points, int num, std::vector<int> &order)
+  {
+    order.resize(num);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [points](int a, int b) { return less(points, a, points, b); });
+  }
+}; // end class LayoutCache
@@ -0,0 +1,631 @@
+/* -*-mode:c; c-basic-offset: 2-*- */
+
+/* OSC streaming of polyspring layouts over UDP
+
+   OscWriter encodes and OscReader decodes OSC 1.0 messages and bundles, UdpSocket sends and receives datagrams,
+   without dependencies beyond POSIX sockets.
+
+   LayoutStreamer sends layout updates to the receiver of polyspring-osc.py's protocol (Max/polyspring.maxpat):
+   per frame, only the points that moved more than a threshold since they were last sent, as runs of rows
+
+     /buffer_index b   /matrixcol colx   /set_matrix row x...   /matrixcol coly   /set_matrix row y...
+
+   packed into bundles of at most one MTU, each bundle self-contained such that a lost datagram loses only its rows.
+   Triangles are sent only when the triangulation changed (at a limited rate), as
+
+     /tri v...   (vertex indices, 3 per triangle)
+
+   if the list fits into one datagram of at most tri_max_size_ bytes (as routed by Max/polyspring-test.maxpat), else in chunks of
+
+     /tri_part start total v...   (start: index of first vertex index, total: number of vertex indices)
+
+   which receivers must reassemble: a chunk with start 0 begins a new list of total indices, the list is complete when all
+   total indices have arrived; a list missing a chunk (lost datagram) is dropped when the next one begins. The Max patches
+   don't route /tri_part, so with them triangles of large corpora are only sent with tri_max_size_ up to 65507 (loopback).
+
+   followed by /step 1 after a frame with changes and /update 1 once converged.
+   Frames are taken from solver snapshots, either by the caller (send_frame) or by a streaming thread at a limited frame rate,
+   decoupled from the solver; datagrams can be paced to a maximum byte rate.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// OSC ENCODING
+
+// builds one OSC packet: a message, or a bundle of messages (elements are not nested)
+class OscWriter
+{
+  std::vector<char> data_;
+  size_t	    element_ = 0;	// position of the current bundle element's size
+  bool		    bundle_  = false;
+
+  void pad () { data_.resize((data_.size() + 3) & ~size_t(3), 0); }
+
+public:
+  // padded size of an OSC string of len characters
+  static size_t string_size (size_t len) { return (len + 4) & ~size_t(3); }
+  // size of a message with address of addrlen characters and numargs 4-byte arguments, plus its size field in a bundle
+  static size_t message_size (size_t addrlen, size_t numargs, bool in_bundle = true) { return string_size(addrlen) + string_size(numargs + 1) + numargs * 4 + (in_bundle ? 4 : 0); }
+
+  void clear () { data_.clear(); bundle_ = false; }
+  size_t      size () const { return data_.size(); }
+  const char *data () const { return data_.data(); }
+
+  void begin_bundle ()
+  {
+    clear();
+    add_string("#bundle");
+    add_int(0), add_int(1);	// time tag: immediately
+    bundle_ = true;
+  }
+
+  // types without the leading comma, arguments follow with add_int(), add_float(), add_string()
+  void begin_message (const char *address, const char *types)
+  {
+    if (bundle_)
+    {
+      element_ = data_.size();
+      add_int(0);
+    }
+    else
+      data_.clear();
+    add_string(address);
+    data_.push_back(',');
+    add_string(types);
+  }
+
+  // in a bundle: set the size of the message
+  void end_message ()
+  {
+    if (bundle_)
+    {
+      uint32_t size = data_.size() - element_ - 4;
+      for (int i = 0; i < 4; i++)
+	data_[element_ + i] = (char) (size >> (24 - 8 * i));
+    }
+  }
+
+  void add_int (int32_t value)
+  {
+    uint32_t v = value;
+    char     bytes[4] = { (char) (v >> 24), (char) (v >> 16), (char) (v >> 8), (char) v };
+    data_.insert(data_.end(), bytes, bytes + 4);
+  }
+
+  void add_float (float value)
+  {
+    uint32_t v;
+    memcpy(&v, &value, 4);
+    add_int((int32_t) v);
+  }
+
+  void add_string (const char *s)
+  {
+    data_.insert(data_.end(), s, s + strlen(s) + 1);
+    pad();
+  }
+}; // end class OscWriter
+
+
+// one decoded argument, numbers are available as both integer and double
+struct OscArg
+{
+  char	      type = 0;	// OSC type tag
+  int64_t     i = 0;	// i, h, T, F, and truncated f, d
+  double      f = 0;	// f, d, and converted i, h
+  std::string s;	// s, S, c
+
+  // string, or integral number in decimal (e.g. a buffer name sent as symbol or number)
+  std::string text () const
+  {
+    if (type == 's'  ||  type == 'S'  ||  type == 'c')
+      return s;
+    return f == (double) i  ?  std::to_string(i)  :  std::to_string(f);
+  }
+};
+
+// decodes OSC packets, calling handler(address, args) for each message, recursing into bundles
+class OscReader
+{
+  std::vector<OscArg> args_;
+
+  static uint32_t get_uint (const char *p) { return (uint32_t) (uint8_t) p[0] << 24 | (uint32_t) (uint8_t) p[1] << 16 | (uint32_t) (uint8_t) p[2] << 8 | (uint8_t) p[3]; }
+
+  // string at data + pos, advances pos past its padding, NULL if not terminated
+  static const char *get_string (const char *data, size_t size, size_t &pos)
+  {
+    const char *s   = data + pos;
+    const char *end = static_cast<const char *>(memchr(s, 0, size - pos));
+    if (!end)
+      return NULL;
+    pos += OscWriter::string_size(end - s);
+    return pos <= size  ?  s  :  NULL;
+  }
+
+public:
+  // returns false on malformed data (messages before the error are handled)
+  template<typename F>
+  bool parse (const char *data, size_t size, F &&handler)
+  {
+    if (size >= 8  &&  memcmp(data, "#bundle", 8) == 0)
+    {
+      for (size_t pos = 16; pos + 4 <= size; )
+      {
+	uint32_t len = get_uint(data + pos);
+	if (len > size - pos - 4  ||  !parse(data + pos + 4, len, handler))
+	  return false;
+	pos += 4 + len;
+      }
+      return size >= 16;
+    }
+
+    size_t	pos = 0;
+    const char *address = get_string(data, size, pos);
+    const char *types	= pos < size  ?  get_string(data, size, pos)  :  ",";
+    if (!address  ||  !types  ||  *address != '/'  ||  *types != ',')
+      return false;
+
+    args_.clear();
+    for (const char *t = types + 1; *t; t++)
+    {
+      OscArg arg;
+      arg.type = *t;
+      switch (*t)
+      {
+      case 'i': case 'f': case 'c': case 'r': case 'm':
+	if (pos + 4 > size)
+	  return false;
+	if (*t == 'f')
+	{
+	  uint32_t v = get_uint(data + pos);
+	  float    f;
+	  memcpy(&f, &v, 4);
+	  arg.f = f;
+	  arg.i = (int64_t) f;
+	}
+	else if (*t == 'c')
+	  arg.s = std::string(1, (char) get_uint(data + pos));
+	else
+	  arg.f = arg.i = (int32_t) get_uint(data + pos);
+	pos += 4;
+	break;
+
+      case 'h': case 'd': case 't':
+      {
+	if (pos + 8 > size)
+	  return false;
+	uint64_t v = (uint64_t) get_uint(data + pos) << 32 | get_uint(data + pos + 4);
+	if (*t == 'd')
+	{
+	  memcpy(&arg.f, &v, 8);
+	  arg.i = (int64_t) arg.f;
+	}
+	else
+	  arg.f = arg.i = (int64_t) v;
+	pos += 8;
+	break;
+      }
+
+      case 's': case 'S':
+      {
+	const char *s = get_string(data, size, pos);
+	if (!s)
+	  return false;
+	arg.s = s;
+	break;
+      }
+
+      case 'b':
+      {
+	if (pos + 4 > size)
+	  return false;
+	uint32_t len = get_uint(data + pos);
+	if (len > size - pos - 4)
+	  return false;
+	arg.s.assign(data + pos + 4, len);
+	pos += 4 + ((len + 3) & ~3u);
+	break;
+      }
+
+      case 'T': arg.f = arg.i = 1; break;
+      case 'F': case 'N': case 'I': break;
+      default:
+	return false;	// unknown size
+      }
+      args_.push_back(std::move(arg));
+    }
+
+    handler(address, args_);
+    return true;
+  } // end OscReader::parse ()
+}; // end class OscReader
+
+
+///////////////////////////////////////////////////////////////////////////////
+// UDP
+
+class UdpSocket
+{
+  int		   fd_ = -1;
+  sockaddr_storage dest_ = {};
+  socklen_t	   destlen_ = 0;
+
+public:
+  UdpSocket () {}
+  UdpSocket (const UdpSocket &) = delete;
+  ~UdpSocket () { close(); }
+
+  // for sending to host:port
+  bool open (const char *host, const char *port)
+  {
+    close();
+    addrinfo hints = {}, *res = NULL;
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host  ?  host  :  "127.0.0.1", port, &hints, &res) != 0  ||  !res)
+      return false;
+    fd_ = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd_ >= 0)
+    {
+      memcpy(&dest_, res->ai_addr, res->ai_addrlen);
+      destlen_ = res->ai_addrlen;
+    }
+    freeaddrinfo(res);
+    return fd_ >= 0;
+  }
+
+  // for receiving on port of all local addresses (host NULL) or of host
+  bool bind (const char *host, const char *port)
+  {
+    close();
+    addrinfo hints = {}, *res = NULL;
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = AI_PASSIVE;
+    if (getaddrinfo(host, port, &hints, &res) != 0  ||  !res)
+      return false;
+    fd_ = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd_ >= 0)
+    { // room for bursts of datagrams (capped by the system)
+      int bufsize = 4 << 20;
+      setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+      if (::bind(fd_, res->ai_addr, res->ai_addrlen) != 0)
+	close();
+    }
+    freeaddrinfo(res);
+    return fd_ >= 0;
+  }
+
+  void close ()
+  {
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+  }
+
+  bool is_open () { return fd_ >= 0; }
+
+  bool send (const char *data, size_t size)
+  {
+    return fd_ >= 0  &&  sendto(fd_, data, size, 0, reinterpret_cast<sockaddr *>(&dest_), destlen_) == (ssize_t) size;
+  }
+
+  // wait at most timeout_ms (-1 forever) for a datagram, returns its size, 0 on timeout, -1 on error
+  int receive (char *buffer, size_t size, int timeout_ms)
+  {
+    pollfd pfd = { fd_, POLLIN, 0 };
+    int    ready = poll(&pfd, 1, timeout_ms);
+    if (ready <= 0)
+      return ready;
+    return recv(fd_, buffer, size, 0);
+  }
+}; // end class UdpSocket
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LAYOUT STREAMING
+
+class LayoutStreamer
+{
+public:
+  double threshold_ = 1e-3;	// send points that moved more than threshold_ times the layout's extent since they were last sent
+  int	 merge_gap_ = 8;	// also send up to this many unmoved points to join two runs of moved points
+  size_t mtu_ = 1472;		// max datagram size: ethernet MTU minus IP and UDP headers
+  double frame_rate_ = 25;	// max frames per second of the streaming thread
+  double byte_rate_  = 0;	// max bytes per second, 0 for no pacing
+  size_t tri_max_size_ = 0;	// max size of a single /tri datagram when above mtu_ (up to 65507, IP-fragmented), for receivers without /tri_part
+  double tri_rate_   = 4;	// max triangle lists per second (the last one is always sent at convergence), 0 for every change
+  int	 colx_ = 2, coly_ = 3;	// receiver's matrix columns for layout x and y
+  bool	 send_update_ = true;	// send /update 1 once converged (off when the caller signals the end itself)
+
+  struct Stats { long frames = 0, packets = 0, bytes = 0, points = 0, triangulations = 0, errors = 0; };
+
+  LayoutStreamer () {}
+  ~LayoutStreamer () { stop(); }
+
+  bool open (const char *host, const char *port) { return socket_.open(host, port); }
+
+  // receiver's buffer index for each block of points in set_points() order, default all points in buffer 1
+  void set_buffers (int numbuffers, const int bufsizes[], const int bufindices[] = NULL)
+  {
+    buffer_start_.assign(1, 0);
+    buffer_index_.clear();
+    for (int b = 0; b < numbuffers; b++)
+    {
+      buffer_start_.push_back(buffer_start_.back() + bufsizes[b]);
+      buffer_index_.push_back(bufindices  ?  bufindices[b]  :  b + 1);
+    }
+    reset();
+  }
+
+  // send all points and triangles with the next frame (e.g. after set_points()), not while the streaming thread runs
+  void reset ()
+  {
+    sent_.clear();
+    tri_count_ = -1;
+    tri_time_  = {};
+    converged_ = false;
+  }
+
+  const Stats &get_stats () { return stats_; }
+
+  // send the changes of snapshot snap (Polyspring::Snapshot) since the last frame, returns the number of bytes sent
+  template<typename SnapshotT>
+  size_t send_frame (const SnapshotT &snap)
+  {
+    int    numpoints = snap.points.size() / 2;
+    size_t bytes = 0;
+    if (numpoints == 0)	// nothing published yet
+      return 0;
+
+    if (sent_.size() != snap.points.size())
+    { // full frame: threshold relative to the layout's extent
+      sent_.assign(snap.points.size(), NAN);
+      tri_count_ = -1;
+      double lo[2] = { INFINITY, INFINITY }, hi[2] = { -INFINITY, -INFINITY };
+      for (int i = 0; i < numpoints * 2; i++)
+      {
+	lo[i & 1] = std::min<double>(lo[i & 1], snap.points[i]);
+	hi[i & 1] = std::max<double>(hi[i & 1], snap.points[i]);
+      }
+      tolerance_ = numpoints > 0  ?  threshold_ * std::max(hi[0] - lo[0], hi[1] - lo[1])  :  0;
+    }
+    if (buffer_start_.empty()  ||  buffer_start_.back() != numpoints)
+    { // default or stale buffers: all in one
+      buffer_start_ = { 0, numpoints };
+      buffer_index_ = { 1 };
+    }
+
+    // runs of moved points within each buffer, joined over short gaps
+    int numsent = 0;
+    writer_.clear();
+    for (size_t b = 0; b + 1 < buffer_start_.size(); b++)
+    {
+      int run = -1, last = -1;	// start and last moved point of current run
+      for (int i = buffer_start_[b]; i <= buffer_start_[b + 1]; i++)
+      {
+	bool moved = i < buffer_start_[b + 1]  &&  !(std::fabs(snap.points[i * 2] - sent_[i * 2]) <= tolerance_  &&  std::fabs(snap.points[i * 2 + 1] - sent_[i * 2 + 1]) <= tolerance_);
+	if (run >= 0  &&  (i == buffer_start_[b + 1]  ||  (moved  &&  i - last > merge_gap_ + 1)))
+	{ // flush run
+	  bytes += add_run(snap.points.data(), b, run, last + 1);
+	  numsent += last + 1 - run;
+	  run = -1;
+	}
+	if (moved)
+	{
+	  if (run < 0)
+	    run = i;
+	  last = i;
+	}
+      }
+    }
+    bytes += flush();
+
+    // triangles only when changed
+    auto now = std::chrono::steady_clock::now();
+    if (snap.tri_count != tri_count_  &&  !snap.triangles.empty()
+	&&  (snap.converged  ||  tri_rate_ <= 0  ||  now - tri_time_ >= std::chrono::duration<double>(1 / tri_rate_)))
+    {
+      bytes += send_triangles(snap.triangles);
+      tri_count_ = snap.tri_count;
+      tri_time_  = now;
+      stats_.triangulations++;
+    }
+
+    if (bytes > 0)
+    {
+      writer_.begin_message("/step", "i");
+      writer_.add_int(1);
+      bytes += send(writer_);
+    }
+    if (snap.converged  &&  !converged_  &&  send_update_)
+    {
+      writer_.begin_message("/update", "i");
+      writer_.add_int(1);
+      bytes += send(writer_);
+    }
+    converged_ = snap.converged;
+
+    stats_.frames++;
+    stats_.points += numsent;
+    return bytes;
+  } // end LayoutStreamer::send_frame ()
+
+  // stream snapshots of solver for reader (see Polyspring::set_snapshot_readers()) in a thread, at most frame_rate_ frames per second,
+  // each new iteration published by the solver (background solver, or publish() by the iterating thread) makes a frame
+  template<typename SolverT>
+  void start (SolverT &solver, int reader = 0)
+  {
+    stop();
+    quit_ = false;
+    thread_ = std::thread([this, &solver, reader]
+    {
+      int count = -1;
+      while (!quit_)
+      {
+	auto next = std::chrono::steady_clock::now() + std::chrono::duration<double>(1 / std::max(frame_rate_, 1e-3));
+	const auto &snap = solver.get_snapshot(reader);
+	if (snap.count != count  ||  snap.converged != converged_  ||  sent_.size() != snap.points.size())
+	{
+	  send_frame(snap);
+	  count = snap.count;
+	}
+	std::this_thread::sleep_until(next);
+      }
+    });
+  }
+
+  void stop ()
+  {
+    quit_ = true;
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+private:
+  UdpSocket	      socket_;
+  OscWriter	      writer_;
+  std::vector<double> sent_;		// interleaved coords last sent per point, NAN if never
+  double	      tolerance_ = 0;
+  int		      tri_count_ = -1;	// triangulation last sent
+  std::chrono::steady_clock::time_point tri_time_;
+  bool		      converged_ = false;
+  std::vector<int>    buffer_start_, buffer_index_;
+  int		      bundle_buffer_ = -1;	// buffer selected in the pending bundle
+  std::chrono::steady_clock::time_point next_send_;
+  Stats		      stats_;
+  std::thread	      thread_;
+  std::atomic<bool>   quit_{false};
+
+  // bytes of one run of num rows in a bundle: /matrixcol and /set_matrix for x and y
+  static size_t run_size (size_t num)
+  {
+    return 2 * (OscWriter::message_size(strlen("/matrixcol"), 1) + OscWriter::message_size(strlen("/set_matrix"), num + 1));
+  }
+  static size_t buffer_size () { return OscWriter::message_size(strlen("/buffer_index"), 1); }
+
+  // add rows [begin, end) of buffer b to bundles, sending full ones, returns bytes sent
+  template<typename T>
+  size_t add_run (const T *points, int b, int begin, int end)
+  {
+    size_t bytes = 0;
+    while (begin < end)
+    {
+      if (writer_.size() > 0  &&  writer_.size() + buffer_size() + run_size(std::min(end - begin, 16)) > mtu_)
+	bytes += flush();
+      if (writer_.size() == 0)
+      {
+	writer_.begin_bundle();
+	bundle_buffer_ = -1;
+      }
+      if (bundle_buffer_ != b)
+      {
+	writer_.begin_message("/buffer_index", "i");
+	writer_.add_int(buffer_index_[b]);
+	writer_.end_message();
+	bundle_buffer_ = b;
+      }
+
+      // as many rows as fit
+      int num = end - begin;
+      while (num > 1  &&  writer_.size() + run_size(num) > mtu_)
+	num = std::min(num - 1, (int) ((mtu_ - writer_.size()) / 10));
+      types_.assign(1, 'i');
+      types_.resize(num + 1, 'f');
+
+      for (int d = 0; d < 2; d++)
+      {
+	writer_.begin_message("/matrixcol", "i");
+	writer_.add_int(d == 0  ?  colx_  :  coly_);
+	writer_.end_message();
+	writer_.begin_message("/set_matrix", types_.c_str());
+	writer_.add_int(begin - buffer_start_[b]);
+	for (int i = begin; i < begin + num; i++)
+	  writer_.add_float(points[i * 2 + d]);
+	writer_.end_message();
+      }
+      for (int i = begin; i < begin + num; i++)
+      {
+	sent_[i * 2]     = points[i * 2];
+	sent_[i * 2 + 1] = points[i * 2 + 1];
+      }
+      begin += num;
+    }
+    return bytes;
+  } // end LayoutStreamer::add_run ()
+
+  // send pending bundle
+  size_t flush ()
+  {
+    size_t bytes = writer_.size() > 0  ?  send(writer_)  :  0;
+    writer_.clear();
+    return bytes;
+  }
+
+  // one /tri message if the list fits into a datagram, else /tri_part chunks
+  size_t send_triangles (const std::vector<size_t> &triangles)
+  {
+    size_t bytes = 0;
+    size_t total = triangles.size();
+    if (OscWriter::message_size(strlen("/tri"), total, false) <= std::max(mtu_, tri_max_size_))
+    {
+      types_.assign(total, 'i');
+      writer_.begin_message("/tri", types_.c_str());
+      for (size_t v : triangles)
+	writer_.add_int(v);
+      return send(writer_);
+    }
+
+    size_t chunk = (mtu_ - OscWriter::message_size(strlen("/tri_part"), 2, false)) / 5;	// 4 bytes and a type tag per index
+    while (OscWriter::message_size(strlen("/tri_part"), chunk + 2, false) > mtu_)
+      chunk--;
+    for (size_t start = 0; start < total; start += chunk)
+    {
+      size_t num = std::min(chunk, total - start);
+      types_.assign(num + 2, 'i');
+      writer_.begin_message("/tri_part", types_.c_str());
+      writer_.add_int(start);
+      writer_.add_int(total);
+      for (size_t i = start; i < start + num; i++)
+	writer_.add_int(triangles[i]);
+      bytes += send(writer_);
+    }
+    return bytes;
+  }
+
+  // send packet, paced to byte_rate_
+  size_t send (const OscWriter &packet)
+  {
+    if (byte_rate_ > 0)
+    {
+      auto now = std::chrono::steady_clock::now();
+      if (next_send_ > now)
+	std::this_thread::sleep_until(next_send_);
+      next_send_ = std::max(now, next_send_) + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(packet.size() / byte_rate_));
+    }
+    if (!socket_.send(packet.data(), packet.size()))
+      stats_.errors++;
+    stats_.packets++;
+    stats_.bytes += packet.size();
+    return packet.size();
+  }
+
+  std::string types_;	// scratch for type tags
+}; // end class LayoutStreamer
@@ -21,6 +21,7 @@ https://github.com/delfrrr/delaunator-cpp/blob/master/include/delaunator.hpp
 single header
 points as interleaved vector<double> (---> vector<pair<buffer, marker> ???)
 returns triangles as vector<int> of point indices √
+--> ported to polyspring-delaunay.hpp to keep its buffers between retriangulations (no allocation in iterate)
 
 
 - bl4ckb0ne / delaunay-triangulation
@@ -47,21 +48,98 @@ https://github.com/Neverland1026/Delaunay_2D_CPP/commit/30d11bc967f26b2dc9e95670
 */
 
 
+#pragma once
+
 #include <cfloat>
 #include <cmath>
+#include <cstring>      // for memcpy
+#include <cstdint>
 #include <vector>
-#include <numeric>      // for iota
+#include <numeric>      // for iota, partial_sum
+#include <limits>
 #include <algorithm>    // for sort
-#include "delaunator.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <iterator>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <tuple>
+#include <typeinfo>     // for layout cache keys
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>  // for force kernel
+#endif
+#include "polyspring-delaunay.hpp"
 
 
 #define DEBUG_POLY (DEBUG * 0)
 
 
+///////////////////////////////////////////////////////////////////////////////
+// DEBUG ALLOCATION COUNTER
+
+// define POLYSPRING_COUNT_ALLOCATIONS before including polyspring.hpp to count heap allocations in polyspring_allocation_count_,
+// incremented by the program's replacement of the global operator new (see tests/test-allocations.cpp);
+// Polyspring::get_allocation_count() then returns the number of allocations so far
+#ifdef POLYSPRING_COUNT_ALLOCATIONS
+inline std::atomic<long> polyspring_allocation_count_(0);
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// STATISTICS
+
+// define POLYSPRING_STATS before including polyspring.hpp to collect IterationStats per iteration (Polyspring::get_stats()),
+// without it the instrumentation compiles to nothing and the stats stay zero
+#ifdef POLYSPRING_STATS
+#define POLYSPRING_STAT(statement) statement
+#else
+#define POLYSPRING_STAT(statement)
+#endif
+
+struct IterationStats
+{
+  enum Timer { TRIANGULATE, EDGES_SET, EDGES_UPDATE, SCALING, FORCES, POINTS, CHECK, NUM_TIMERS };
+
+  int	 iteration = 0;
+  double time[NUM_TIMERS] = { 0 };	// seconds per part of the iteration, triangulation and edge set as far as done in this iteration
+  bool	 full_triangulation = false;	// a full triangulation was completed in this iteration
+  int	 flips = 0;			// edge flips by incremental repair
+  int	 numedges = 0;
+  int	 forced_edges = 0;		// compressed springs, with positive force
+  int	 pushed_back = 0;		// points moved back into the region
+  double max_move = 0, mean_move = 0;	// displacement of points inside the region, relative to l0_uni
+  double energy = 0;			// spring energy sum 1/2 k compression^2, relative to l0_uni^2, should fall towards convergence
+
+  static const char *timer_name (int timer)
+  {
+    static const char *names[NUM_TIMERS] = { "triangulate", "edges_set", "edges_update", "scaling_factor", "forces", "points", "retri_check" };
+    return names[timer];
+  }
+};
+
+// adds wall time of its scope to a stats time slot
+class StatsTimer
+{
+  double &time_;
+  std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+public:
+  StatsTimer (double &time) : time_(time) { }
+  ~StatsTimer () { time_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count(); }
+};
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // UTILITIES
 
-void print_points (const char * msg, int num, float *buf, int width = 2, int xcol = 0, int ycol = 1)
+inline void print_points (const char * msg, int num, float *buf, int width = 2, int xcol = 0, int ycol = 1)
 {
   if (msg && msg[0])
     printf("%s (num %d)\n", msg, num);
@@ -101,6 +179,38 @@ void blockwise (int numbuffers, int bufsizes[], CoordT *buffers[], F&& func)
 #define y(index) ((index) * 2 + 1)
 
 
+// half-edge navigation in delaunator's triangle list: half-edge e is the edge from vertex triangles[e] to the next vertex of its triangle
+inline size_t next_halfedge (size_t e) { return (e % 3 == 2)  ?  e - 2  :  e + 1; }
+inline size_t prev_halfedge (size_t e) { return (e % 3 == 0)  ?  e + 2  :  e - 1; }
+
+// 64 bit hash of size bytes at data, chained through h, for cache keys (not cryptographic):
+// multiply-xorshift on 8 byte words, fast enough to hash a corpus of millions of points in milliseconds
+inline uint64_t hash_bytes (const void *data, size_t size, uint64_t h = 0x84222325cbf29ce4ull)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  const uint64_t mul = 0x9e3779b97f4a7c15ull;
+  size_t i = 0;
+
+  for (; i + 8 <= size; i += 8)
+  {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, 8);
+    h  = (h ^ word) * mul;
+    h ^= h >> 29;
+  }
+  for (; i < size; i++)
+    h = (h ^ bytes[i]) * mul;
+  h ^= size;
+  h *= mul;
+  return h ^ (h >> 32);
+}
+
+template<typename T>
+uint64_t hash_value (const T &value, uint64_t h) { return hash_bytes(&value, sizeof(T), h); }
+
+// geometric predicates orient2d and incircle (exact sign) are in polyspring-delaunay.hpp, shared with the triangulator
+
+
 // vector function wrappers
 template<typename CoordT>
 void copy_with_strides (int num, CoordT *src, int srcstride, CoordT *dest, int deststride, CoordT &min, CoordT &max)
@@ -120,6 +230,50 @@ void copy_with_strides (int num, CoordT *src, int srcstride, CoordT *dest, int d
   }
 }
 
+// inverse of copy_with_strides for one column of normalised points: dest = src * scale + offset (+ orig * interp), the arithmetic vectorises
+template<typename CoordT>
+void scale_with_strides (int num, const CoordT *src, int srcstride, const CoordT *orig, CoordT scale, CoordT offset, CoordT interp, CoordT *dest, int deststride)
+{
+  if (orig)
+    for (int i = 0; i < num; i++)
+      dest[i * deststride] = src[i * srcstride] * scale + offset + orig[i * srcstride] * interp;
+  else
+    for (int i = 0; i < num; i++)
+      dest[i * deststride] = src[i * srcstride] * scale + offset;
+}
+
+// scale_with_strides for points in another order: dest row i gets point index[i] of interleaved src (and orig)
+template<typename CoordT>
+void scale_gather (int num, const int *index, const CoordT *src, const CoordT *orig, CoordT scale, CoordT offset, CoordT interp, CoordT *dest, int deststride)
+{
+  if (orig)
+    for (int i = 0; i < num; i++)
+      dest[i * deststride] = src[2 * index[i]] * scale + offset + orig[2 * index[i]] * interp;
+  else
+    for (int i = 0; i < num; i++)
+      dest[i * deststride] = src[2 * index[i]] * scale + offset;
+}
+
+// point i of interleaved out is point perm[i] of in
+template<typename CoordT>
+void gather_interleaved (const std::vector<int> &perm, const std::vector<CoordT> &in, std::vector<CoordT> &out)
+{
+  out.resize(in.size());
+  for (size_t i = 0; i < perm.size(); i++)
+  {
+    out[x(i)] = in[x(perm[i])];
+    out[y(i)] = in[y(perm[i])];
+  }
+}
+
+// point i of interleaved vec becomes point perm[i], through scratch (keeps the capacity of both)
+template<typename CoordT>
+void permute_interleaved (const std::vector<int> &perm, std::vector<CoordT> &vec, std::vector<CoordT> &scratch)
+{
+  gather_interleaved(perm, vec, scratch);
+  vec.swap(scratch);
+}
+
 template<typename CoordT>
 void vector_add(std::vector<CoordT> &a, std::vector<CoordT> &b)
 { // a + b
@@ -138,14 +292,217 @@ std::vector<CoordT> vector_mul(std::vector<CoordT> &a, std::vector<CoordT> &b)
 */
 
 template<typename CoordT>
-std::vector<CoordT> vector_norm (std::vector<CoordT> &a)
+void vector_norm (int num, const CoordT *vx, const CoordT *vy, CoordT *norm)
 { // norm = sqrt(vec_x ^ 2 + vec_y ^ 2);
-  std::vector<CoordT> norm(a.size() / 2);
-  for (int i = 0; i < norm.size(); i++)
-    norm[i] += sqrt(a[x(i)] * a[x(i)] + a[y(i)] * a[y(i)]);
-  return norm;
+  for (int i = 0; i < num; i++)
+    norm[i] = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+}
+
+// spring force kernel: for each edge with vector (dx, dy), length len and relative rest length r = 1 / h,
+// compute repulsive force f = k * (rest * r - len), clipped to 0 if negative (branch-free),
+// and return force vector along edge direction (fx, fy) = dt * f * (dx, dy) / len
+// zero-length edges (coinciding points) are pushed along x, like atan2(0, 0) = 0 did
+template<typename CoordT>
+void spring_force_kernel_scalar (int begin, int end, const CoordT *dx, const CoordT *dy, const CoordT *len, const CoordT *r,
+				 CoordT rest, CoordT k, CoordT dt, CoordT *fx, CoordT *fy)
+{
+  for (int i = begin; i < end; i++)
+  {
+    CoordT f   = dt * std::max(k * (rest * r[i] - len[i]), (CoordT) 0);
+    bool   pos = len[i] > 0;
+    CoordT inv = pos  ?  1 / len[i]  :  0;
+
+    fx[i] = f * (pos  ?  dx[i] * inv  :  1);
+    fy[i] = f * dy[i] * inv;
+  }
+}
+
+template<typename CoordT>
+void spring_force_kernel (int num, const CoordT *dx, const CoordT *dy, const CoordT *len, const CoordT *r,
+			  CoordT rest, CoordT k, CoordT dt, CoordT *fx, CoordT *fy)
+{ // generic version: rely on compiler auto-vectorisation
+  spring_force_kernel_scalar(0, num, dx, dy, len, r, rest, k, dt, fx, fy);
 }
 
+// single precision specialisation with explicit AVX or SSE intrinsics, scalar loop for the remainder
+template<>
+inline void spring_force_kernel<float> (int num, const float *dx, const float *dy, const float *len, const float *r,
+				       float rest, float k, float dt, float *fx, float *fy)
+{
+  int i = 0;
+#if defined(__AVX__)
+  const __m256 vrest = _mm256_set1_ps(rest), vk = _mm256_set1_ps(k), vdt = _mm256_set1_ps(dt);
+  const __m256 zero  = _mm256_setzero_ps(),  one = _mm256_set1_ps(1);
+
+  for (; i + 8 <= num; i += 8)
+  {
+    __m256 l   = _mm256_loadu_ps(len + i);
+    __m256 f   = _mm256_mul_ps(vk, _mm256_sub_ps(_mm256_mul_ps(vrest, _mm256_loadu_ps(r + i)), l));
+    f          = _mm256_mul_ps(vdt, _mm256_max_ps(f, zero));
+    __m256 pos = _mm256_cmp_ps(l, zero, _CMP_GT_OQ);
+    __m256 inv = _mm256_and_ps(pos, _mm256_div_ps(one, l)); // 0 where len == 0
+    __m256 ux  = _mm256_blendv_ps(one, _mm256_mul_ps(_mm256_loadu_ps(dx + i), inv), pos);
+    __m256 uy  = _mm256_mul_ps(_mm256_loadu_ps(dy + i), inv);
+    _mm256_storeu_ps(fx + i, _mm256_mul_ps(f, ux));
+    _mm256_storeu_ps(fy + i, _mm256_mul_ps(f, uy));
+  }
+#elif defined(__SSE2__)
+  const __m128 vrest = _mm_set1_ps(rest), vk = _mm_set1_ps(k), vdt = _mm_set1_ps(dt);
+  const __m128 zero  = _mm_setzero_ps(),  one = _mm_set1_ps(1);
+
+  for (; i + 4 <= num; i += 4)
+  {
+    __m128 l   = _mm_loadu_ps(len + i);
+    __m128 f   = _mm_mul_ps(vk, _mm_sub_ps(_mm_mul_ps(vrest, _mm_loadu_ps(r + i)), l));
+    f          = _mm_mul_ps(vdt, _mm_max_ps(f, zero));
+    __m128 pos = _mm_cmpgt_ps(l, zero);
+    __m128 inv = _mm_and_ps(pos, _mm_div_ps(one, l));
+    __m128 ux  = _mm_or_ps(_mm_and_ps(pos, _mm_mul_ps(_mm_loadu_ps(dx + i), inv)), _mm_andnot_ps(pos, one));
+    __m128 uy  = _mm_mul_ps(_mm_loadu_ps(dy + i), inv);
+    _mm_storeu_ps(fx + i, _mm_mul_ps(f, ux));
+    _mm_storeu_ps(fy + i, _mm_mul_ps(f, uy));
+  }
+#endif
+  spring_force_kernel_scalar(i, num, dx, dy, len, r, rest, k, dt, fx, fy);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// THREAD POOL
+
+// fixed set of worker threads running one function on all threads at a time, the calling thread takes part as thread 0
+// work is split in static chunks such that results are deterministic for a given number of threads
+// no allocation per run: the function is passed by pointer to the caller's lambda
+class ThreadPool
+{
+  std::vector<std::thread> threads_;
+  std::mutex		mutex_;
+  std::condition_variable start_cond_, done_cond_;
+  int		numthreads_ = 1;
+  unsigned	generation_ = 0;	// incremented for each run, wakes up workers
+  int		pending_    = 0;	// number of workers still running current function
+  bool		quit_	    = false;
+  void		(*func_)(void *context, int thread, int numthreads) = NULL;
+  void		*context_ = NULL;
+
+  // seen: generation at start, so that workers restarted by set_num_threads don't rerun the last function
+  void worker (int thread, unsigned seen)
+  {
+
+    while (true)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cond_.wait(lock, [&] { return quit_  ||  generation_ != seen; });
+      if (quit_)
+	return;
+      seen = generation_;
+      lock.unlock();
+
+      func_(context_, thread, numthreads_);
+
+      lock.lock();
+      if (--pending_ == 0)
+	done_cond_.notify_one();
+    }
+  }
+
+  void stop ()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    start_cond_.notify_all();
+    for (auto &t : threads_)
+      t.join();
+    threads_.clear();
+    quit_ = false;
+  }
+
+public:
+  ThreadPool () {}
+  ThreadPool (const ThreadPool &) = delete;
+  ~ThreadPool () { stop(); }
+
+  // set number of threads including calling thread, 0 = hardware concurrency
+  void set_num_threads (int num)
+  {
+    if (num <= 0)
+      num = std::max(1, (int) std::thread::hardware_concurrency());
+    if (num == numthreads_)
+      return;
+
+    stop();
+    numthreads_ = num;
+    for (int i = 1; i < num; i++)
+      threads_.emplace_back(&ThreadPool::worker, this, i, generation_);
+  }
+
+  int get_num_threads () { return numthreads_; }
+
+  // get static chunk [begin, end) of num elements for thread
+  static void chunk (int num, int thread, int numthreads, int &begin, int &end)
+  {
+    begin = (int) ((long long) num * thread       / numthreads);
+    end   = (int) ((long long) num * (thread + 1) / numthreads);
+  }
+
+  // call func(thread, numthreads) on all threads, return when all are done
+  template<typename F>
+  void run (F &&func)
+  {
+    if (numthreads_ <= 1)
+    {
+      func(0, 1);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      func_ = [](void *context, int thread, int numthreads) { (*static_cast<typename std::remove_reference<F>::type *>(context))(thread, numthreads); };
+      context_ = &func;
+      pending_ = numthreads_ - 1;
+      generation_++;
+    }
+    start_cond_.notify_all();
+
+    func(0, numthreads_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cond_.wait(lock, [&] { return pending_ == 0; });
+  }
+
+  // call func(begin, end, thread) on static chunks of range 0..num
+  template<typename F>
+  void parallel_for (int num, F &&func)
+  {
+    run([&](int thread, int numthreads)
+	{
+	  int begin, end;
+	  chunk(num, thread, numthreads, begin, end);
+	  func(begin, end, thread);
+	});
+  }
+
+  // resumable parallel_for(): call func(begin, end, thread) on part [pos, pos + step) of each thread's static chunk of range 0..num,
+  // so that successive calls with pos += step visit the same elements per thread in the same order as one parallel_for(),
+  // returns true when the parts reached the end of all chunks
+  template<typename F>
+  bool parallel_for_part (int num, size_t pos, size_t step, F &&func)
+  {
+    run([&](int thread, int numthreads)
+	{
+	  int begin, end;
+	  chunk(num, thread, numthreads, begin, end);
+	  size_t size = end - begin;
+	  if (pos < size)
+	    func(begin + (int) pos, begin + (int) (pos + std::min(step, size - pos)), thread);
+	});
+    size_t longest = ((size_t) num + numthreads_ - 1) / numthreads_;
+    return pos >= longest  ||  step >= longest - pos;
+  }
+}; // end class ThreadPool
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // Regions
@@ -155,6 +512,8 @@ template<typename CoordT>
 class Region
 {
 public:
+  virtual ~Region () = default; // owned regions (PolygonRegion) are deleted through the base pointer
+
   virtual double get_area () = 0;
 
   // inner box, with inset margin
@@ -163,10 +522,38 @@ public:
   virtual bool point_is_within (CoordT x, CoordT y) = 0;
   virtual void move_point_back (CoordT &x, CoordT &y) = 0;
 
+  // chain the region's shape into hash h (for layout cache keys), by default its area and inner box
+  virtual uint64_t hash (uint64_t h)
+  {
+    CoordT box[4];
+    get_inbox(box, box + 2);
+    return hash_value(box, hash_value(get_area(), h));
+  }
+
+  // batched check of points [begin, end) of an interleaved array: move points outside back into the region and flag them in outside[i - begin],
+  // one call per block of points instead of two per point
+  virtual void constrain (int begin, int end, CoordT *points, char *outside)
+  {
+    constrain_points(*this, begin, end, points, outside);
+  }
+
+protected:
+  // generic loop for constrain(), called with the final region type to bind point_is_within and move_point_back statically
+  template<typename RegionT>
+  static void constrain_points (RegionT &region, int begin, int end, CoordT *points, char *outside)
+  {
+    for (int i = begin; i < end; i++)
+    {
+      bool out = !region.point_is_within(points[x(i)], points[y(i)]);
+      if (out)
+	region.move_point_back(points[x(i)], points[y(i)]);
+      outside[i - begin] = out;
+    }
+  }
 };
 
 template<typename CoordT>
-class SquareRegion : public Region<CoordT>
+class SquareRegion final : public Region<CoordT>
 {
 public:
   virtual double get_area () override { return 1; }
@@ -188,6 +575,8 @@ public:
   {
     return x >= 0  &&  x <= 1  &&  y >= 0  &&  y <= 1;
   }
+
+  virtual uint64_t hash (uint64_t h) override { return hash_bytes("square", 6, h); }
   
   virtual void move_point_back (CoordT &x, CoordT &y) override
   {
@@ -196,509 +585,3911 @@ public:
     if (y < 0)  y = 0;
     if (y > 1)  y = 1;
   }
-}; // end class SquareRegion
 
+  // branch-free clamp, vectorises
+  virtual void constrain (int begin, int end, CoordT *points, char *outside) override
+  {
+    for (int i = begin; i < end; i++)
+    {
+      CoordT px = points[x(i)], py = points[y(i)];
+      CoordT cx = std::min(std::max(px, (CoordT) 0), (CoordT) 1);
+      CoordT cy = std::min(std::max(py, (CoordT) 0), (CoordT) 1);
+
+      outside[i - begin] = (cx != px) | (cy != py);
+      points[x(i)] = cx;
+      points[y(i)] = cy;
+    }
+  }
+}; // end class SquareRegion
 
 
-///////////////////////////////////////////////////////////////////////////////
+// arbitrary polygon with holes, convex or concave
+// for constant time containment and projection, the bounding box is covered by a grid of square cells, classified as
+// inside, outside, or boundary (intersected by a polygon segment); boundary cells keep a list of the segments in their 5x5 cell neighbourhood,
+// which contains the nearest segment of any point in the cell, for points in other cells, the nearest boundary cells are searched
 template<typename CoordT>
-struct Edges
-{ // built from triangulation, needs to be updated after point moved
-  int numedges_ = 0;
-  std::vector<CoordT> length_;	// length of edge = norm of dist_
-  std::vector<CoordT> dist_;	// interleaved x/y vector of edge length
-  //float mid_x, mid_y;// only needed for h_dist calculation
-  std::vector<CoordT> h_dist_;  // vector of target density evaluated at mid_x/y
-  std::vector<int>    a_, b_;	// indices into Points arrays to end points
-  const double	edge_correction_ = 1;	// factor taking into account that we store unique edges, while python code visits every edge twice via the near list of point a containing b and reciprocally b containing a
-  CoordT (*get_h_)(CoordT x, CoordT y);
+class PolygonRegion final : public Region<CoordT>
+{
+  struct Segment { double ax, ay, bx, by; };
+  enum { OUTSIDE = -1, BOUNDARY = 0, INSIDE = 1 };
 
-  Edges (CoordT (*hfunc)(CoordT x, CoordT y))
-  : get_h_(hfunc) {}
+  std::vector<Segment> segments_;
+  double area_ = 0;
+  double center_[2] = { 0.5, 0.5 };	// centroid
 
-  void init (int num)
+  // grid
+  int	 numx_ = 0, numy_ = 0;	// number of cells
+  double x0_ = 0, y0_ = 0;	// lower left corner
+  double cell_ = 1;		// cell size
+  std::vector<signed char> state_;	// cell state OUTSIDE, BOUNDARY, INSIDE
+  std::vector<char>	   center_in_;	// cell center is inside
+  std::vector<int>	   start_;	// boundary cell's segment list start index into cellseg_, (numcells + 1)
+  std::vector<int>	   cellseg_;	// concatenated segment lists
+
+  static bool segments_cross (double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy)
   {
-    numedges_ = num;
-    //TDB: .clear()?
-    length_.resize(num);
-    dist_.resize(num * 2);
-    h_dist_.resize(num);
-    a_.clear();
-    b_.clear();
-    a_.reserve(num);
-    b_.reserve(num);
+    double d1 = orient2d(ax, ay, bx, by, cx, cy), d2 = orient2d(ax, ay, bx, by, dx, dy);
+    double d3 = orient2d(cx, cy, dx, dy, ax, ay), d4 = orient2d(cx, cy, dx, dy, bx, by);
+    return ((d1 > 0) != (d2 > 0))  &&  ((d3 > 0) != (d4 > 0));
   }
 
-  void add (int a, int b)
+  // nearest point on segment
+  static double project (const Segment &s, double px, double py, double &nx, double &ny)
   {
-    a_.push_back(a);
-    b_.push_back(b);
+    double ux = s.bx - s.ax, uy = s.by - s.ay;
+    double len2 = ux * ux + uy * uy;
+    double t = len2 > 0  ?  ((px - s.ax) * ux + (py - s.ay) * uy) / len2  :  0;
+
+    t  = std::min(std::max(t, 0.), 1.);
+    nx = s.ax + t * ux;
+    ny = s.ay + t * uy;
+    return (px - nx) * (px - nx) + (py - ny) * (py - ny);
   }
 
-  // build edges end point lists from interleaved triangle vertex index list
-  void set (std::vector<size_t> &tri)
+  // segment intersects cell (ix, iy)?
+  bool segment_in_cell (const Segment &s, int ix, int iy)
   {
-    int numtri = tri.size() / 3;
-    init(numtri * 3); // each triangle contributes 3 edges
+    double x1 = x0_ + ix * cell_, y1 = y0_ + iy * cell_, x2 = x1 + cell_, y2 = y1 + cell_;
 
-    // go through triangles, add each of the 3 edges between the 3 points (indices a, b, c)
-    for (int i = 0; i < numtri; i++)
-    { // vertex point indices into points array
-      int a = tri[i * 3];
-      int b = tri[i * 3 + 1];
-      int c = tri[i * 3 + 2];
-      
-      add(a, b);
-      add(b, c);
-      add(c, a);
-    }
+    if (std::max(s.ax, s.bx) < x1  ||  std::min(s.ax, s.bx) > x2  ||  std::max(s.ay, s.by) < y1  ||  std::min(s.ay, s.by) > y2)
+      return false;	// bounding boxes don't overlap
+    if (s.ax >= x1  &&  s.ax <= x2  &&  s.ay >= y1  &&  s.ay <= y2)
+      return true;	// end point inside
 
-    //TODO: check if edge a, b or b, a already exists, remove, resize other vectors
-  } // end Edges::set ()
+    // box corners on both sides of the segment's line?
+    double o1 = orient2d(s.ax, s.ay, s.bx, s.by, x1, y1), o2 = orient2d(s.ax, s.ay, s.bx, s.by, x2, y1);
+    double o3 = orient2d(s.ax, s.ay, s.bx, s.by, x2, y2), o4 = orient2d(s.ax, s.ay, s.bx, s.by, x1, y2);
+    return !((o1 > 0  &&  o2 > 0  &&  o3 > 0  &&  o4 > 0)  ||  (o1 < 0  &&  o2 < 0  &&  o3 < 0  &&  o4 < 0));
+  }
 
-  // update edges after points have moved
-  void update (std::vector<CoordT> &points)
+  int cell_index (double px, double py, bool clamp)
   {
-/*  for (auto e: edges_)
-    {
-	e.dist_x = point_[2 * e.b]     - point_[2 * e.a];
-	e.dist_y = point_[2 * e.b + 1] - point_[2 * e.a + 1];
-	e.length = std::sqrt(e.dist_x * e.dist_x + e.dist_y * e.dist_y);
-	CoordT midx = point_[2 * e.a]     + 0.5 * e.dist_x;
-	CoordT midy = point_[2 * e.a + 1] + 0.5 * e.dist_y;
-	h_dist = get_h(midx, midy);
-    }
-*/
-    for (int i = 0; i < numedges_; i++)
+    int ix = (int) std::floor((px - x0_) / cell_);
+    int iy = (int) std::floor((py - y0_) / cell_);
+
+    if (ix < 0  ||  ix >= numx_  ||  iy < 0  ||  iy >= numy_)
     {
-      dist_[x(i)] = points[x(b_[i])] - points[x(a_[i])];
-      dist_[y(i)] = points[y(b_[i])] - points[y(a_[i])];
+      if (!clamp)
+	return -1;
+      ix = std::min(std::max(ix, 0), numx_ - 1);
+      iy = std::min(std::max(iy, 0), numy_ - 1);
     }
-    length_ = vector_norm(dist_); // length = sqrt(dist_x ^ 2 + dist_y ^ 2);
+    return iy * numx_ + ix;
+  }
 
-    for (int i = 0; i < numedges_; i++)
-    { // get middle point and lookup density function
-      CoordT midx = points[x(a_[i])] + 0.5 * dist_[x(i)];
-      CoordT midy = points[y(a_[i])] + 0.5 * dist_[y(i)];
-      h_dist_[i]  = get_h_(midx, midy);
+  void build_grid (int gridsize)
+  {
+    double xmin = DBL_MAX, ymin = DBL_MAX, xmax = -DBL_MAX, ymax = -DBL_MAX;
+    for (auto &s : segments_)
+    {
+      xmin = std::min(xmin, s.ax);
+      xmax = std::max(xmax, s.ax);
+      ymin = std::min(ymin, s.ay);
+      ymax = std::max(ymax, s.ay);
     }
-  } // end Edges::update ()
 
-  // called after setting/updating edges
-  double scaling_factor ()
-  { /* for point in self.points:
-	   for near in point.near:
-		npair += 1
-		midx ,midy = point.midTo(near)
-		target_area += 1 / self.h_dist(midx, midy)**2 
-      return self.l0_uni * np.sqrt(npair / target_area)
- */
-     // loop over edges (do over precalculated density h at edges midpoints)
-    //double target_area = sum(1. / (h_dist_ * h_dist_) * edge_correction_);
-    double target_area = 0;
-    for (int i = 0; i < numedges_; i++)
-      target_area += 1. / (h_dist_[i] * h_dist_[i] * edge_correction_);
-    
-    return sqrt(numedges_ / target_area);
-  } // end Edges::scaling_factor ()
+    // square cells, one cell margin around bounding box
+    cell_ = std::max(std::max(xmax - xmin, ymax - ymin) / gridsize, 1e-9);
+    x0_   = xmin - cell_;
+    y0_   = ymin - cell_;
+    numx_ = (int) std::ceil((xmax - xmin) / cell_) + 2;
+    numy_ = (int) std::ceil((ymax - ymin) / cell_) + 2;
+    int numcells = numx_ * numy_;
 
-  // apply spring repulsive force f to edge index i's end points' push vectors
-  void apply_force (int i, double f, std::vector<CoordT> &push)
-  {
-/*  def repulsiveForce(self, f, point):
-        angle = np.arctan2(self.y - point.y, self.x - point.x)
-        self.push_x += f * np.cos(angle)
-        self.push_y += f * np.sin(angle)
-        self.shap = ShPoint(
-            self.x + self.push_x,
-            self.y + self.push_y) # update the shapely point now for outside observation
-*/
-    double angle = atan2((double) dist_[y(i)], (double) dist_[x(i)]);
-    push[x(a_[i])] -= f * cos(angle);
-    push[y(a_[i])] -= f * sin(angle);
-    push[x(b_[i])] += f * cos(angle);
-    push[y(b_[i])] += f * sin(angle);
+    // mark boundary cells with their intersecting segments
+    std::vector<std::vector<int>> hits(numcells);
+    for (int k = 0; k < (int) segments_.size(); k++)
+    {
+      const Segment &s = segments_[k];
+      int ix1 = std::max(0, (int) std::floor((std::min(s.ax, s.bx) - x0_) / cell_)), ix2 = std::min(numx_ - 1, (int) std::floor((std::max(s.ax, s.bx) - x0_) / cell_));
+      int iy1 = std::max(0, (int) std::floor((std::min(s.ay, s.by) - y0_) / cell_)), iy2 = std::min(numy_ - 1, (int) std::floor((std::max(s.ay, s.by) - y0_) / cell_));
 
-#if DEBUG_POLY > 3
-    printf("apply_force %.3f angle %5.2f edge %d [%d, %d]\n", f, angle, i, a_[i], b_[i]);
-#endif
-  }
-}; // end struct Edges
+      for (int iy = iy1; iy <= iy2; iy++)
+	for (int ix = ix1; ix <= ix2; ix++)
+	  if (segment_in_cell(s, ix, iy))
+	    hits[iy * numx_ + ix].push_back(k);
+    }
 
+    // classify cell centers by crossing parity along each row's center line
+    state_.resize(numcells);
+    center_in_.resize(numcells);
+    std::vector<double> crossings;
+    for (int iy = 0; iy < numy_; iy++)
+    {
+      double yc = y0_ + (iy + 0.5) * cell_;
 
-///////////////////////////////////////////////////////////////////////////////
-template<typename CoordT>
-struct Triangulation
-{
-  std::vector<double> tripoints_;	// interleaved(!) array of x/y coordinates for delaunay triangulation (must be double for delaunator), need to keep for use in dist_since_triangulation
-  std::vector<size_t> *vertices_;	// interleaved(!) array of triplets of triangle vertex indices (into tripoints array)
-  delaunator::Delaunator *del_ = NULL;
-  int tri_count_ = 0;
+      crossings.clear();
+      for (auto &s : segments_)
+	if ((s.ay > yc) != (s.by > yc))
+	  crossings.push_back(s.ax + (yc - s.ay) * (s.bx - s.ax) / (s.by - s.ay));
+      std::sort(crossings.begin(), crossings.end());
 
-  void init (int num)
-  {
-    tripoints_.reserve(num * 2); // don't init elements, will be overwritten by triangulate()
-    tri_count_ = 0;
-  }
+      size_t c = 0;
+      for (int ix = 0; ix < numx_; ix++)
+      {
+	double xc = x0_ + (ix + 0.5) * cell_;
+	while (c < crossings.size()  &&  crossings[c] < xc)
+	  c++;
 
-  void triangulate (std::vector<CoordT> &points)
-  {
-    tripoints_.assign(points.begin(), points.end()); // copy input points and convert to double
+	int k = iy * numx_ + ix;
+	center_in_[k] = c % 2;
+	state_[k] = !hits[k].empty()  ?  BOUNDARY  :  (c % 2  ?  INSIDE  :  OUTSIDE);
+      }
+    }
 
-    // setup and call delaunay triangulation
-    if (del_) 
+    // boundary cells: collect segments of 5x5 neighbourhood
+    start_.assign(numcells + 1, 0);
+    cellseg_.clear();
+    std::vector<int> list;
+    for (int k = 0; k < numcells; k++)
     {
-      delete del_;
-      del_ = NULL; // "new" might be interrupted by exception
-    }
-    del_ = new delaunator::Delaunator(tripoints_);
-    vertices_ = &del_->triangles;
+      start_[k] = cellseg_.size();
+      if (state_[k] != BOUNDARY)
+	continue;
 
-    tri_count_++;
+      int ix = k % numx_, iy = k / numx_;
+      list.clear();
+      for (int jy = std::max(0, iy - 2); jy <= std::min(numy_ - 1, iy + 2); jy++)
+	for (int jx = std::max(0, ix - 2); jx <= std::min(numx_ - 1, ix + 2); jx++)
+	  list.insert(list.end(), hits[jy * numx_ + jx].begin(), hits[jy * numx_ + jx].end());
+      std::sort(list.begin(), list.end());
+      list.erase(std::unique(list.begin(), list.end()), list.end());
+      cellseg_.insert(cellseg_.end(), list.begin(), list.end());
+    }
+    start_[numcells] = cellseg_.size();
+  } // end PolygonRegion::build_grid ()
 
-#if DEBUG_POLY > 2
-    for (int i = 0; i < vertices_->size(); i += 3)
+  void nearest_in_list (int begin, int end, const int *list, double px, double py, double &best, double &nx, double &ny)
+  {
+    for (int i = begin; i < end; i++)
     {
-      printf("tri %3d: %3d %3d %3d\n", i / 3, (*vertices_)[i], (*vertices_)[i + 1], (*vertices_)[i + 2]);
+      double qx, qy;
+      double d = project(segments_[list ? list[i] : i], px, py, qx, qy);
+      if (d < best)
+      {
+	best = d;
+	nx = qx;
+	ny = qy;
+      }
     }
-#endif
   }
 
-  std::vector<size_t> &get_vertices() { return *vertices_; }
-};
+  // nearest boundary point, returns squared distance
+  double nearest (double px, double py, double &nx, double &ny)
+  {
+    int    k = cell_index(px, py, false);
+    double best = DBL_MAX;
 
+    nx = px;
+    ny = py;
+    if (k < 0)
+    { // far outside, rare: try all segments
+      nearest_in_list(0, segments_.size(), NULL, px, py, best, nx, ny);
+    }
+    else if (state_[k] == BOUNDARY)
+    { // nearest segment is at most a cell diagonal away, so it is in the cell's list
+      nearest_in_list(start_[k], start_[k + 1], cellseg_.data(), px, py, best, nx, ny);
+    }
+    else
+    { // find closest ring of cells around k containing boundary cells, at distance r
+      // the nearest segment is then closer than (r + 1) cell diagonals, search all boundary cells within that distance
+      int ix = k % numx_, iy = k / numx_;
+      int r  = 1;
+      for (bool found = false; !found  &&  r < std::max(numx_, numy_); r++)
+	for (int jy = std::max(0, iy - r); !found  &&  jy <= std::min(numy_ - 1, iy + r); jy++)
+	  for (int jx = std::max(0, ix - r); jx <= std::min(numx_ - 1, ix + r); jx++)
+	    if (state_[jy * numx_ + jx] == BOUNDARY)
+	    {
+	      found = true;
+	      break;
+	    }
 
-///////////////////////////////////////////////////////////////////////////////
-template<typename CoordT>
-struct Points
-{
-  int numpoints_ = 0;
-  std::vector<CoordT> points_;	// normalised interleaved point coords 0..1, created by pre-uniformisation
-  std::vector<CoordT> push_;	// interleaved displacement vector x/y
+      int rmax = (int) std::ceil(r * M_SQRT2) - 1; // r was incremented after found, 5x5 lists cover 2 more cells
+      for (int jy = std::max(0, iy - rmax); jy <= std::min(numy_ - 1, iy + rmax); jy++)
+	for (int jx = std::max(0, ix - rmax); jx <= std::min(numx_ - 1, ix + rmax); jx++)
+	{
+	  int j = jy * numx_ + jx;
+	  if (state_[j] == BOUNDARY)
+	    nearest_in_list(start_[j], start_[j + 1], cellseg_.data(), px, py, best, nx, ny);
+	}
+    }
+    return best;
+  } // end PolygonRegion::nearest ()
 
-  // original bounds before normalisation
-  std::vector<CoordT> bounds_min_{0, 0};
-  std::vector<CoordT> bounds_range_{1, 1};
-  std::vector<CoordT> scaled_points_;	// interleaved points scaled back from normalised coords 0..1 to original bounds
+public:
+  PolygonRegion () {}
 
-  void get_bounds (std::vector<CoordT> &bounds_min, std::vector<CoordT> &bounds_range)
+  // set polygon from numrings rings of ringsizes[i] interleaved x/y vertices in normalised coordinates (rings are closed implicitly),
+  // the first ring is the outer boundary, the following are holes
+  PolygonRegion (int numrings, const int ringsizes[], const CoordT *coords, int gridsize = 64)
   {
-    bounds_min   = bounds_min_;
-    bounds_range = bounds_range_;
+    set(numrings, ringsizes, coords, gridsize);
   }
 
-  std::vector<CoordT> &get_points_interleaved (bool scaled = false)
+  void set (int numrings, const int ringsizes[], const CoordT *coords, int gridsize = 64)
   {
-    if (scaled)
+    double sumx = 0, sumy = 0;
+
+    segments_.clear();
+    area_ = 0;
+    for (int r = 0; r < numrings; r++)
     {
-      scaled_points_.resize(numpoints_ * 2);
-      for (int i = 0; i < numpoints_; i++)
+      int    num = ringsizes[r];
+      double ringarea = 0, cx = 0, cy = 0;
+
+      for (int i = 0; i < num; i++)
       {
-	scaled_points_[x(i)] = points_[x(i)] * bounds_range_[0] + bounds_min_[0];
-	scaled_points_[y(i)] = points_[y(i)] * bounds_range_[1] + bounds_min_[1];
+	const CoordT *a = coords + 2 * i, *b = coords + 2 * ((i + 1) % num);
+	double cross = (double) a[0] * b[1] - (double) b[0] * a[1];
+
+	segments_.push_back({ a[0], a[1], b[0], b[1] });
+	ringarea += cross / 2;
+	cx += (a[0] + b[0]) * cross / 6;
+	cy += (a[1] + b[1]) * cross / 6;
       }
-      return scaled_points_;
+
+      // outer ring adds, holes subtract, whatever their orientation
+      double sign = (r == 0) == (ringarea > 0)  ?  1  :  -1;
+      area_ += sign * ringarea;
+      sumx  += sign * cx;
+      sumy  += sign * cy;
+      coords += 2 * num;
     }
-    else
-      return points_;
-  } // end Points::get_points_interleaved ()
 
-  void init (int num)
-  {
-    numpoints_ = num;
-    points_.resize(num * 2);
-    push_.resize(num * 2);
+    if (area_ > 0)
+    {
+      center_[0] = sumx / area_;
+      center_[1] = sumy / area_;
+    }
+    build_grid(std::max(4, gridsize));
+  } // end PolygonRegion::set ()
+
+  virtual double get_area () override { return area_; }
+
+  virtual void get_inbox (CoordT ll[2], CoordT ur[2]) override
+  { // like python: box of side 2 * sqrt(area) / 3 around centroid
+    double inside = sqrt(area_) / 3;
+
+    ll[0] = center_[0] - inside;
+    ll[1] = center_[1] - inside;
+    ur[0] = center_[0] + inside;
+    ur[1] = center_[1] + inside;
   }
 
-  void set (int numtotal, int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int colx, int coly)
+  virtual bool point_is_within (CoordT x, CoordT y) override
   {
-    CoordT xmin =  FLT_MAX, ymin =  FLT_MAX;
-    CoordT xmax = -FLT_MAX, ymax = -FLT_MAX;
-    
-    numpoints_ = numtotal;
-    points_.resize(2 * numtotal);
-    push_.resize(2 * numtotal);
+    int k = cell_index(x, y, false);
+    if (k < 0)
+      return false;
+    if (state_[k] != BOUNDARY)
+      return state_[k] == INSIDE;
 
-    // copy from blocks into interleaved vector and get min/max x/y
-    blockwise(numbuffers, bufsizes, buffers,
-	      [&](int bufsize, CoordT *buffer, int offset) -> void
-	      {
-		copy_with_strides(bufsize, buffer + colx, bufwidth, points_.data() + offset * 2,     2, xmin, xmax);
-		copy_with_strides(bufsize, buffer + coly, bufwidth, points_.data() + offset * 2 + 1, 2, ymin, ymax);
-	      });
+    // boundary cell: flip cell center's parity for each segment crossed on the way from the center to the point
+    double xc = x0_ + (k % numx_ + 0.5) * cell_;
+    double yc = y0_ + (k / numx_ + 0.5) * cell_;
+    bool   in = center_in_[k];
 
-    bounds_min_[0] = xmin;
-    bounds_min_[1] = ymin;
-    bounds_range_[0] = xmax - xmin;
-    bounds_range_[1] = ymax - ymin;
-  } // end Points::set ()
-  
-  CoordT pre_uniformize (Region<CoordT> &region)
-  { // replace points (in descriptor coordinates) by normalised sort index
+    for (int i = start_[k]; i < start_[k + 1]; i++)
+    {
+      const Segment &s = segments_[cellseg_[i]];
+      if (segments_cross(xc, yc, x, y, s.ax, s.ay, s.bx, s.by))
+	in = !in;
+    }
+    return in;
+  }
 
-    // get inbox for generating pre-uniformised coords
-    CoordT p1[2], p2[2], len[2];
-    region.get_inbox(p1, p2);
-    len[0] = p2[0] - p1[0];
-    len[1] = p2[1] - p1[1];
+  // move to nearest point on the boundary
+  virtual void move_point_back (CoordT &x, CoordT &y) override
+  {
+    double nx, ny;
+    nearest(x, y, nx, ny);
+    x = nx;
+    y = ny;
+  }
 
-#if DEBUG_POLY
-    printf("pre_uniformize inbox (%f, %f) (%f, %f)\n", p1[0], p1[1], p2[0], p2[1]);
-#endif
-    
-    // create rank array of size numframes
-    std::vector<size_t> indices(numpoints_);
-
-    // for each column
-    for (int colind = 0; colind < 2; colind++)
-    {
-      // fill rank array with 0..numframes
-      std::iota(begin(indices), end(indices), static_cast<size_t>(0));
-
-      // sort rank array with indirection to data
-      std::sort(
-        begin(indices), end(indices),
-        [&](size_t a, size_t b)
-        {
-          // ascending order, such that small elements get small indices
-          return points_[a * 2 + colind] < points_[b * 2 + colind];
-        }
-      );
-      
-      // scale sorted indices to 0 + inset .. 1 - inset and copy order of elem back to points
-      for (size_t i = 0; i < numpoints_; i++)
-      {
-        size_t order = indices[i];
-	points_[order * 2 + colind] = ((CoordT) i / (numpoints_ - 1)) * len[colind] + p1[colind];
-      }
-    } // end for colind
+  virtual void constrain (int begin, int end, CoordT *points, char *outside) override
+  {
+    this->constrain_points(*this, begin, end, points, outside);
+  }
 
-    return len[1]; // return y dimension of inbox
-  } // end Points::pre_uniformize ()
-  
-  void update ()
+  virtual uint64_t hash (uint64_t h) override { return hash_bytes(segments_.data(), segments_.size() * sizeof(Segment), h); }
+
+  // signed distance to boundary, negative inside
+  double signed_distance (CoordT x, CoordT y)
   {
-#if DEBUG_POLY > 1
-    for (int i = 0; i < numpoints_; i++)
-      printf("up %3d (%.3f, %.3f) push (%.3f, %.3f)\n", i, points_[x(i)], points_[y(i)], push_[x(i)], push_[y(i)]);
+    double nx, ny;
+    double d = std::sqrt(nearest(x, y, nx, ny));
+    return point_is_within(x, y)  ?  -d  :  d;
+  }
+}; // end class PolygonRegion
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Grids
+
+// grids of float values over the normalised 0..1 square, width x height values,
+// padded to (width + 1) x (height + 1) by duplicating the last row and column, to avoid clamping the upper interpolation index
+
+inline void grid_pad (std::vector<float> &grid, int width, int height)
+{
+  int stride = width + 1;
+
+  for (int j = 0; j < height; j++)
+    grid[j * stride + width] = grid[j * stride + width - 1];
+  std::copy(grid.begin() + (height - 1) * stride, grid.begin() + height * stride, grid.begin() + height * stride);
+}
+
+// scalar bilinear lookup at normalised position x, y (clamped to 0..1)
+template<typename CoordT>
+CoordT grid_lookup (const float *grid, int width, int height, CoordT px, CoordT py)
+{
+  int   stride = width + 1;
+  float fx = std::min(std::max((float) px, 0.f), 1.f) * (width  - 1);
+  float fy = std::min(std::max((float) py, 0.f), 1.f) * (height - 1);
+  int   ix = (int) fx, iy = (int) fy;
+  float tx = fx - ix, ty = fy - iy;
+  const float *g = grid + iy * stride + ix;
+
+  float g0 = g[0]      + tx * (g[1]          - g[0]);
+  float g1 = g[stride] + tx * (g[stride + 1] - g[stride]);
+  return g0 + ty * (g1 - g0);
+}
+
+// bilinear lookup of num positions, with AVX2 gather for single precision
+template<typename CoordT>
+void grid_sample (const float *grid, int width, int height, int num, const CoordT *px, const CoordT *py, CoordT *out)
+{
+  int i = 0;
+#if defined(__AVX2__)
+  if constexpr (std::is_same<CoordT, float>::value)
+  {
+    const int    stride = width + 1;
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1);
+    const __m256 sx = _mm256_set1_ps(width - 1), sy = _mm256_set1_ps(height - 1);
+    const __m256i vstride = _mm256_set1_epi32(stride);
+
+    for (; i + 8 <= num; i += 8)
+    {
+      __m256  fx = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(px + i), zero), one), sx);
+      __m256  fy = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(py + i), zero), one), sy);
+      __m256i ix = _mm256_cvttps_epi32(fx), iy = _mm256_cvttps_epi32(fy);
+      __m256  tx = _mm256_sub_ps(fx, _mm256_cvtepi32_ps(ix));
+      __m256  ty = _mm256_sub_ps(fy, _mm256_cvtepi32_ps(iy));
+      __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(iy, vstride), ix);
+      __m256  g00 = _mm256_i32gather_ps(grid,              idx, 4);
+      __m256  g10 = _mm256_i32gather_ps(grid + 1,          idx, 4);
+      __m256  g01 = _mm256_i32gather_ps(grid + stride,     idx, 4);
+      __m256  g11 = _mm256_i32gather_ps(grid + stride + 1, idx, 4);
+      __m256  g0  = _mm256_add_ps(g00, _mm256_mul_ps(tx, _mm256_sub_ps(g10, g00)));
+      __m256  g1  = _mm256_add_ps(g01, _mm256_mul_ps(tx, _mm256_sub_ps(g11, g01)));
+      _mm256_storeu_ps(out + i, _mm256_add_ps(g0, _mm256_mul_ps(ty, _mm256_sub_ps(g1, g0))));
+    }
+  }
 #endif
-    
-    vector_add(points_, push_);    // points_ += push_;
+  for (; i < num; i++)
+    out[i] = grid_lookup(grid, width, height, px[i], py[i]);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Density
+
+// target density h given as grid over the normalised 0..1 square,
+// precomputed as relative spring rest length field r = 1 / h, normalised to mean 1, with bilinear lookup
+template<typename CoordT>
+class DensityMap
+{
+  int width_  = 0;	// grid size
+  int height_ = 0;
+  std::vector<float> rest_;	// padded grid of r
+
+  void init (int width, int height)
+  {
+    width_  = std::max(1, width);
+    height_ = std::max(1, height);
+    rest_.resize((width_ + 1) * (height_ + 1));
   }
 
-  void end_iteration ()
-  { // set push vector to zero
-    std::fill(push_.begin(), push_.end(), 0);
+  void finish ()
+  { // normalise to mean 1 and pad
+    int    stride = width_ + 1;
+    double sum = 0;
+    for (int j = 0; j < height_; j++)
+      for (int i = 0; i < width_; i++)
+	sum += rest_[j * stride + i];
+
+    float norm = sum > 0  ?  width_ * height_ / sum  :  1;
+    for (int j = 0; j < height_; j++)
+      for (int i = 0; i < width_; i++)
+	rest_[j * stride + i] *= norm;
+    grid_pad(rest_, width_, height_);
   }
-  
-  bool within_region (int i, Region<CoordT> *region)
+
+public:
+  int get_width ()  const { return width_; }
+  int get_height () const { return height_; }
+
+  // set from buffer of width x height density values h, e.g. a jitter matrix,
+  // value at grid column i (x) and row j (y) is density[j * rowstride + i * colstride], rowstride 0 means width * colstride
+  // densities <= 0 are clipped to 1e-6 of the maximum
+  void set (int width, int height, const float *density, int colstride = 1, int rowstride = 0)
   {
-    return region->point_is_within(points_[x(i)], points_[y(i)]);
+    init(width, height);
+    if (rowstride == 0)
+      rowstride = width_ * colstride;
+
+    float hmax = 0;
+    for (int j = 0; j < height_; j++)
+      for (int i = 0; i < width_; i++)
+	hmax = std::max(hmax, density[j * rowstride + i * colstride]);
+
+    float hmin = hmax > 0  ?  hmax * 1e-6f  :  1;
+    for (int j = 0; j < height_; j++)
+      for (int i = 0; i < width_; i++)
+	rest_[j * (width_ + 1) + i] = 1 / std::max(density[j * rowstride + i * colstride], hmin);
+    finish();
   }
 
-  void move_point_back (int i, Region<CoordT> *region)
+  // set by evaluating density function h(x, y) at width x height grid points covering 0..1
+  template<typename F>
+  void set_function (int width, int height, F &&hfunc)
   {
-    region->move_point_back(points_[x(i)], points_[y(i)]); // changes points coords
+    std::vector<float> density(std::max(1, width) * std::max(1, height));
+
+    for (int j = 0; j < height; j++)
+      for (int i = 0; i < width; i++)
+	density[j * width + i] = hfunc(width  > 1  ?  (CoordT) i / (width  - 1)  :  0.5,
+				       height > 1  ?  (CoordT) j / (height - 1)  :  0.5);
+    set(width, height, density.data());
   }
 
-  CoordT norm (CoordT x1, CoordT y1)
+  // chain the map into hash h (for layout cache keys)
+  uint64_t hash (uint64_t h) const
   {
-    return std::sqrt(x1 * x1 + y1 * y1);
+    h = hash_value(width_, hash_value(height_, h));
+    return hash_bytes(rest_.data(), rest_.size() * sizeof(float), h);
   }
 
-  CoordT dist_moved (int i)
+  // bilinear lookup of relative rest length at normalised position x, y
+  CoordT lookup (CoordT px, CoordT py) const
   {
-    return norm(push_[x(i)], push_[y(i)]);
+    return grid_lookup(rest_.data(), width_, height_, px, py);
   }
 
-  CoordT dist_since_triangulation (int i, Triangulation<CoordT> &tri)
+  void sample (int num, const CoordT *px, const CoordT *py, CoordT *out) const
   {
-    return norm(points_[x(i)] - tri.tripoints_[x(i)], points_[y(i)] - tri.tripoints_[y(i)]);
+    grid_sample(rest_.data(), width_, height_, num, px, py, out);
   }
-}; // end struct Points
+}; // end class DensityMap
 
 
+// density policies for Polyspring and Edges, chosen at compile time:
+// uniform is constant 1 and drops the midpoint lookup and rest length scaling from the iteration,
+// a density map pointer can be swapped at run time, NULL for uniform
 
-///////////////////////////////////////////////////////////////////////////////
 template<typename CoordT>
-class Polyspring
+struct UniformDensity
 {
-public:
-  // simulation parameters
-  double dt_	   = 0.2;   // simulation step
-  double tri_tol_  = 0.1;   // displacement threshold (relative to l0_uni) for retriangularisation
-  double int_pres_ = 1.2;   // spring pressure
-  double k_	   = 1;     // spring stiffness (supposing mass = 1)
-  double stop_tol_ = 0.001;
-      
-  //h_dist: function to get target distance for point
-  Region<CoordT>	*region_ = NULL;
+  static constexpr bool uniform = true;
 
-  Points<CoordT>	points_;	// points container
-  Triangulation<CoordT> triangulation_;	// wrapper around delaunay triangulation
-  Edges<CoordT>		edges_;		// keeps list of edges
-  double		l0_uni_;	// spring rest length
-  int			count_ = 0;
-  bool			update_tri_ = false;
+  bool is_uniform () const { return true; }
+  void sample (int num, const CoordT *px, const CoordT *py, CoordT *out) const { std::fill(out, out + num, 1); }
+};
 
-public:
-  Polyspring ()
-  : edges_(get_h),	// default: uniform
-    region_(new SquareRegion<CoordT>) // set default region 0..1 square, signed distance function, inner box
-  {}
+template<typename CoordT>
+struct MapDensity
+{
+  static constexpr bool uniform = false;
+  const DensityMap<CoordT> *map_ = NULL;
 
-  void set_region (std::string name);
-  void set_points (int numtotal, int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int colx, int coly);   // copy points from buffers into vector, do rescaling and pre-uniformisation
-  static CoordT get_h (CoordT x, CoordT y) { return 1; } // TODO: evaluate target density function at point
-  bool iterate ();
-  int get_count() { return count_; };
-  int get_triangulation_count() { return triangulation_.tri_count_; };
-}; // end class Polyspring
+  bool is_uniform () const { return !map_; }
+  void sample (int num, const CoordT *px, const CoordT *py, CoordT *out) const { map_->sample(num, px, py, out); }
+};
 
 
-// copy points from buffers into vector, do rescaling
+///////////////////////////////////////////////////////////////////////////////
+// Attractors
+
+// displacement of a (uniformised) layout towards a mixture of gaussian attractors, port of python's Corpus.simple_attractors:
+// the mixture (each gaussian normalised to max 1) is rasterised with its analytic gradient,
+// rescaled to 0..l0_uni, and each point is moved by density * gradient / (|gradient| + max|gradient| / 1000)
 template<typename CoordT>
-void Polyspring<CoordT>::set_points (int numtotal, int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int colx, int coly)
+class Attractors
 {
-  points_.set(numtotal, numbuffers, bufsizes, buffers, bufwidth, colx, coly);
-#if DEBUG_POLY
-  vector_print("bounds min", points_.bounds_min_);
-  vector_print("     range", points_.bounds_range_);
-#endif
-  
-  // pre-uniformization, replaces points by normalised sort index
-  // and scale points to fit into region's inner box
-  CoordT ydim = points_.pre_uniformize(*region_);
-    
-  if (colx == coly)
-  { // all points are in a line: make triangulation possible by random y displacement
-    const CoordT epsilon = ydim / points_.numpoints_ * 1e-2;	// max random displacement: 1/1000 of inter-point distance
+  std::vector<CoordT> params_;	// 5 parameters per gaussian: mx, my, sigx, sigy, theta
+  int		      size_ = 0;	// grid is size x size
+  std::vector<float>  density_, grad_x_, grad_y_, gauss_;	// padded grids, one gaussian
+  std::vector<CoordT> disp_x_, disp_y_;	// per point sampled gradient, then displacement
+  std::vector<float>  thread_max_;
 
-    for (int i = 0; i < points_.numpoints_; i++)
-      points_.points_[i * 2 + 1] += (CoordT) std::rand() / RAND_MAX * epsilon;
+public:
+  int max_size_ = 512;	// max. grid size, the mixture is smooth, so coarser than python's 2 * sqrt(numpoints) is enough for big corpora
+
+  int get_num () { return params_.size() / 5; }
+
+  // set num gaussians from interleaved parameters (mx, my, sigx, sigy, theta) in normalised coordinates
+  void set (int num, const CoordT *params)
+  {
+    params_.assign(params, params + num * 5);
   }
 
-#if DEBUG_POLY > 2
-  vector_print("pre-uni", points_.points_);
-#endif
+  // rasterise mixture density and gradient on grid of size 2 * ceil(sqrt(numpoints)), like python
+  void rasterize (int numpoints, double l0_uni, ThreadPool &pool)
+  {
+    size_ = std::min(max_size_, std::max(2, 2 * (int) std::ceil(std::sqrt((double) numpoints))));
+    int stride = size_ + 1;
+    int numgrid = stride * (size_ + 1);
+    density_.assign(numgrid, 0);
+    grad_x_.assign(numgrid, 0);
+    grad_y_.assign(numgrid, 0);
+    gauss_.resize(numgrid);
+    thread_max_.resize(pool.get_num_threads());
 
-  // compute the spring rest length
-  // self.l0_uni = np.sqrt(2 / (np.sqrt(3) * len(self.points) / self.region.area))
-  double area = region_->get_area();
-  l0_uni_ = sqrt(2 / (sqrt(3) * numtotal / area));
-  
-  count_ = 0;
-  update_tri_ = true;
-} // end Polyspring::set_points ()
+    for (int k = 0; k < get_num(); k++)
+    { /* a = np.cos(theta)**2/(2*sigx**2) + np.sin(theta)**2/(2*sigy**2)
+	 b = -np.sin(2*theta)/(4*sigx**2) + np.sin(2*theta)/(4*sigy**2)
+	 c = np.sin(theta)**2/(2*sigx**2) + np.cos(theta)**2/(2*sigy**2)
+	 gauss = np.exp(- a*(x-mx)**2 - 2*b*(x-mx)*(y-my) - c*(y-my)**2) */
+      const CoordT *p = &params_[k * 5];
+      float mx = p[0], my = p[1], sx2 = p[2] * p[2], sy2 = p[3] * p[3], theta = p[4];
+      float ct = std::cos(theta), st = std::sin(theta), s2t = std::sin(2 * theta);
+      float a =  ct * ct / (2 * sx2) + st * st / (2 * sy2);
+      float b = -s2t / (4 * sx2)     + s2t / (4 * sy2);
+      float c =  st * st / (2 * sx2) + ct * ct / (2 * sy2);
+
+      // evaluate gaussian on grid, get its max on grid for normalisation
+      pool.parallel_for(size_, [&](int begin, int end, int thread)
+      {
+	float gmax = 0;
+	for (int j = begin; j < end; j++)
+	{
+	  float dy = (float) j / (size_ - 1) - my;
+	  for (int i = 0; i < size_; i++)
+	  {
+	    float dx = (float) i / (size_ - 1) - mx;
+	    float g  = std::exp(-a * dx * dx - 2 * b * dx * dy - c * dy * dy);
+	    gauss_[j * stride + i] = g;
+	    gmax = std::max(gmax, g);
+	  }
+	}
+	thread_max_[thread] = gmax;
+      });
+      float gmax = *std::max_element(thread_max_.begin(), thread_max_.end());
+      if (gmax <= 0)
+	continue;
 
+      // accumulate normalised gaussian and its analytic gradient
+      pool.parallel_for(size_, [&](int begin, int end, int /*thread*/)
+      {
+	for (int j = begin; j < end; j++)
+	{
+	  float dy = (float) j / (size_ - 1) - my;
+	  for (int i = 0; i < size_; i++)
+	  {
+	    float dx = (float) i / (size_ - 1) - mx;
+	    float g  = gauss_[j * stride + i] / gmax;
+	    density_[j * stride + i] += g;
+	    grad_x_[j * stride + i]  -= 2 * (a * dx + b * dy) * g;
+	    grad_y_[j * stride + i]  -= 2 * (b * dx + c * dy) * g;
+	  }
+	}
+      });
+    }
 
-// main loop
-template<typename CoordT>
-bool Polyspring<CoordT>::iterate ()
-{
-  // update triangulation if necessary
-/* 	  if update_tri:
-                tri_count += 1
-                self.delaunayTriangulation()
-                update_tri = False
-*/
-  if (update_tri_)
+    // density = self.l0_uni * (density - density.min()) / (density.max() - density.min())
+    float dmin = FLT_MAX, dmax = -FLT_MAX;
+    for (int j = 0; j < size_; j++)
+      for (int i = 0; i < size_; i++)
+      {
+	dmin = std::min(dmin, density_[j * stride + i]);
+	dmax = std::max(dmax, density_[j * stride + i]);
+      }
+    float scale = dmax > dmin  ?  l0_uni / (dmax - dmin)  :  0;
+
+    for (int j = 0; j < size_; j++)
+      for (int i = 0; i < size_; i++)
+      {
+	density_[j * stride + i] = (density_[j * stride + i] - dmin) * scale;
+	grad_x_[j * stride + i] *= scale;
+	grad_y_[j * stride + i] *= scale;
+      }
+    grid_pad(density_, size_, size_);
+    grid_pad(grad_x_,  size_, size_);
+    grid_pad(grad_y_,  size_, size_);
+  } // end Attractors::rasterize ()
+
+  // displace num interleaved points from in to out (can be the same)
+  void apply (int num, const CoordT *in, CoordT *out, ThreadPool &pool)
   {
-    triangulation_.triangulate(points_.get_points_interleaved());
-    edges_.set(triangulation_.get_vertices());	// construct edges list
-    edges_.update(points_.get_points_interleaved());
-    update_tri_ = false;
-  }
-		  
-  // compute rest length scaling factor
-  double hscale = l0_uni_ * edges_.scaling_factor();
-  //printf("scaling_factor %f\n", hscale);
+    disp_x_.resize(num);
+    disp_y_.resize(num);
+
+    // sample gradient, get max gradient norm
+    pool.parallel_for(num, [&](int begin, int end, int thread)
+    {
+      float gmax = 0;
+      for (int block = begin; block < end; block += 256)
+      {
+	CoordT px[256], py[256];
+	int    n = std::min(256, end - block);
+
+	for (int i = 0; i < n; i++)
+	{
+	  px[i] = in[x(block + i)];
+	  py[i] = in[y(block + i)];
+	}
+	grid_sample(grad_x_.data(), size_, size_, n, px, py, disp_x_.data() + block);
+	grid_sample(grad_y_.data(), size_, size_, n, px, py, disp_y_.data() + block);
+
+	for (int i = block; i < block + n; i++)
+	  gmax = std::max(gmax, (float) std::sqrt(disp_x_[i] * disp_x_[i] + disp_y_[i] * disp_y_[i]));
+      }
+      thread_max_[thread] = gmax;
+    });
+    float eps = *std::max_element(thread_max_.begin(), thread_max_.end()) / 1000;
+
+    // disp = interp_density * grad / (grad_norm + grad_norm.max() / 1000)
+    pool.parallel_for(num, [&](int begin, int end, int /*thread*/)
+    {
+      for (int block = begin; block < end; block += 256)
+      {
+	CoordT px[256], py[256], dens[256];
+	int    n = std::min(256, end - block);
+
+	for (int i = 0; i < n; i++)
+	{
+	  px[i] = in[x(block + i)];
+	  py[i] = in[y(block + i)];
+	}
+	grid_sample(density_.data(), size_, size_, n, px, py, dens);
+
+	for (int i = 0; i < n; i++)
+	{
+	  CoordT gx = disp_x_[block + i], gy = disp_y_[block + i];
+	  CoordT f  = dens[i] / (std::sqrt(gx * gx + gy * gy) + eps);
+	  out[x(block + i)] = px[i] + f * gx;
+	  out[y(block + i)] = py[i] + f * gy;
+	}
+      }
+    });
+  } // end Attractors::apply ()
+}; // end class Attractors
+
+
+///////////////////////////////////////////////////////////////////////////////
+template<typename CoordT, typename DensityT = MapDensity<CoordT>>
+struct Edges
+{ // built from triangulation, needs to be updated after point moved
+  int numedges_ = 0;
+  std::vector<CoordT> length_;	// length of edge = norm of dist_x/y_
+  std::vector<CoordT> dist_x_, dist_y_;	// x/y vector of edge from a to b (planar, not interleaved, for vectorisation)
+  std::vector<CoordT> force_x_, force_y_; // force vector to apply to edge end points, 0 if spring is not compressed
+  std::vector<CoordT> rest_dist_;  // relative spring rest length 1 / h_dist, target density evaluated at edge middle points
+  std::vector<int>    a_, b_;	// indices into Points arrays to end points
+  std::vector<int>    halfedge_edge_;	// edge index for each triangulation half-edge (both twins map to the same edge), for patching after edge flips
+  DensityT	      density_;	// target density policy
+  std::vector<int>    sort_start_, sort_edge_, sort_a_, sort_b_;	// scratch for sort()
+  int		      sort_step_ = 0, sort_pos_ = 0;	// pass and progress of a resumed sort()
 
-  if (count_ == 0) // first iter returns pre-uniformization
+  void init (int maxnum)
   {
-    count_++;
-    return true;
+    sort_step_ = 0;
+    sort_pos_  = 0;
+    a_.clear();
+    b_.clear();
+    a_.reserve(maxnum);
+    b_.reserve(maxnum);
   }
-  
-  // sum repulsive actions for each point
-  /* for point in self.points: 
-  	for near in point.near: // each edge is visited twice!!!!!
-              midX ,midY = point.midTo(near)
-              f = k * (int_pres * hscale / self.h_dist(midX, midY) - point.distTo(near))
-              if f > 0:
-                  near.repulsiveForce(dt * f, point) // update push vector with force from near point
-  */
 
-  // calculate spring forces 
-  for (int i = 0; i < edges_.numedges_; i++) // loop over over precalculated edge length and density h at edges midpoints
+  void add (int a, int b)
   {
-    double f = k_ * (int_pres_ * hscale / edges_.h_dist_[i] - edges_.length_[i]); // TODO: vectorise this loop, second loop with apply_force
-    //printf("force %6.3f edge %d [%d, %d]\n", f, i, edges_.a_[i], edges_.b_[i]);
-    if (f > 0)
-      edges_.apply_force(i, dt_ * f, points_.push_); // update edge's end points' push vectors with force from spring
+    a_.push_back(a);
+    b_.push_back(b);
   }
 
-#if DEBUG_POLY > 2
-  vector_print("push", points_.push_);
-#endif
+  // build unique edge list from triangulation's interleaved triangle vertex index list and half-edge adjacency:
+  // every half-edge e goes from tri[e] to tri[next_halfedge(e)], and an interior edge has its opposite twin halfedges[e] in the neighbouring triangle,
+  // so we keep only the half-edge with the lower index of each pair, plus the hull half-edges without twin
+  void set (std::vector<size_t> &tri, std::vector<size_t> &halfedges)
+  {
+    start_set(tri.size());
+    add_halfedges(tri, halfedges, 0, tri.size());
+    end_set();
+  }
 
-  // MAYBE LATER: handle points which would be moved out of bounding shape:
-  // clip movement of a point A to border, but redistribute overshooting movement (perpendicular to border) as force pushing connected points Bi back from boundary (redistribute according to each point's contributions to overshoot)
-  
-  // move point positions, but leave push
-  points_.update();
+  // resumable set(): start_set(), add_halfedges() for consecutive ranges of half-edges, end_set()
+  void start_set (size_t numhalf)
+  {
+    init((int) numhalf); // upper bound, actual numedges = (numhalf + numhull) / 2
+    halfedge_edge_.resize(numhalf);
+  }
 
-  // second loop after all forces computation
-  /* for point in self.points:        // check stop condition if inside region, else move it back inside
-                if point.shap.within(self.region): # shap point is already pushed
-                    if exit and point.moveDist() / self.l0_uni > stop_tol: 
-                        exit = False
-                else:
-                    point.moveTo(nearest_points(self.region, point.shap)[0].coords[0]) ?????
-  */
-  bool keep_going = false;
-  for (int i = 0; i < points_.numpoints_; i++)
-  { // check stop condition if inside region, else move it back inside
-    if (points_.within_region(i, region_))
+  void add_halfedges (std::vector<size_t> &tri, std::vector<size_t> &halfedges, size_t begin, size_t end)
+  {
+    for (size_t e = begin; e < end; e++)
     {
-      if (!keep_going  &&  points_.dist_moved(i) / l0_uni_ > stop_tol_)
+      size_t twin = halfedges[e];
+
+      if (twin == INVALID_INDEX  ||  e < twin)
       {
-#if DEBUG_POLY	
-	printf("iter %3d: point %d moved %f,  norm %f > stop_tol %f\n", count_, i, points_.dist_moved(i),  points_.dist_moved(i) / l0_uni_, stop_tol_);
-#endif
-	keep_going = true; // any point moved more than stop tolerance: do one more iteration
+	halfedge_edge_[e] = a_.size();
+	if (twin != INVALID_INDEX)
+	  halfedge_edge_[twin] = a_.size();
+        add(tri[e], tri[next_halfedge(e)]);
       }
     }
-    else
-      points_.move_point_back(i, region_);
   }
 
-  // if live update, rescale to descr. coordinates and write to output buffers
-  //points_.get(bounds, outbuffers);
-  
-  // update edges after points have moved
-  edges_.update(points_.points_);
-  /* NOT: for (auto e: edges_)     {
-		e.dist_x += push_[2 * e.b]     - push_[2 * e.a];
-		e.dist_y += push_[2 * e.b + 1] - push_[2 * e.a + 1];
-	   }  */
-
-  // loop over points, 
-  // check if triangulation needs to be updated: moved from prev_x/y more than tri_tol thresh
-  for (int i = 0; i < points_.numpoints_; i++) // todo: vectorise, mostly goes through all points
-    if (points_.dist_since_triangulation(i, triangulation_) / l0_uni_ > tri_tol_)
-    {
-      update_tri_ = true;
+  void end_set ()
+  {
+    numedges_ = a_.size();
+    length_.resize(numedges_);
+    dist_x_.resize(numedges_);
+    dist_y_.resize(numedges_);
+    force_x_.resize(numedges_);
+    force_y_.resize(numedges_);
+    rest_dist_.assign(numedges_, 1);
+  } // end Edges::end_set ()
+
+  // sort edges by their lower end point index (stable counting sort), for spatially ordered points this makes the gathers of update()
+  // and the scatters of scatter_forces() walk through the point arrays almost sequentially;
+  // resumable: each call does up to chunk edges of one pass (count, scatter, renumber half-edges), returns true when sorted
+  bool sort (int numpoints, size_t chunk = std::numeric_limits<size_t>::max())
+  {
+    int num   = sort_step_ < 2  ?  numedges_  :  (int) halfedge_edge_.size();
+    int begin = sort_pos_;
+    int end   = (int) std::min<size_t>(num, begin + std::min<size_t>(chunk, num));
+
+    switch (sort_step_)
+    {
+    case 0: // count edges per lower end point
+      if (begin == 0)
+	sort_start_.assign(numpoints + 1, 0);
+      for (int e = begin; e < end; e++)
+      {
+	if (a_[e] > b_[e])
+	  std::swap(a_[e], b_[e]);
+	sort_start_[a_[e] + 1]++;
+      }
+      if (end == num)
+	std::partial_sum(sort_start_.begin(), sort_start_.end(), sort_start_.begin());
+      break;
+
+    case 1: // scatter, in order of edges for stability
+      if (begin == 0)
+      {
+	sort_edge_.resize(numedges_);
+	sort_a_.resize(numedges_);
+	sort_b_.resize(numedges_);
+      }
+      for (int e = begin; e < end; e++)
+      {
+	int to = sort_start_[a_[e]]++;
+	sort_edge_[e] = to;
+	sort_a_[to] = a_[e];
+	sort_b_[to] = b_[e];
+      }
       break;
+
+    default:
+      for (int h = begin; h < end; h++)
+	halfedge_edge_[h] = sort_edge_[halfedge_edge_[h]];
+      if (end == num)
+      {
+	a_.swap(sort_a_);
+	b_.swap(sort_b_);
+	sort_step_ = 0;
+	sort_pos_  = 0;
+	return true;
+      }
+    }
+
+    sort_pos_ = end;
+    if (end == num)
+    {
+      sort_step_++;
+      sort_pos_ = 0;
     }
+    return false;
+  } // end Edges::sort ()
 
-  // set push to 0
-  points_.end_iteration();
+  // patch edge list after triangulation flipped half-edges a/b of the quad p0, pr, p1, pl (see Triangulation::flip):
+  // the flipped edge now connects p0 and p1, and the edges of half-edges bl and ar moved to a and b
+  void flip (size_t a, size_t b, size_t ar, size_t bl, int p0, int p1)
+  {
+    int flipped = halfedge_edge_[a];
 
-#if DEBUG_POLY > 2
-  vector_print("final", points_.points_);
-#endif
+    halfedge_edge_[a]  = halfedge_edge_[bl];
+    halfedge_edge_[b]  = halfedge_edge_[ar];
+    halfedge_edge_[ar] = flipped;
+    halfedge_edge_[bl] = flipped;
+    a_[flipped] = p0;
+    b_[flipped] = p1;
+  } // end Edges::flip ()
 
-  count_++;
-  return keep_going;
-} // end Polyspring::iterate ()
+  // patch edge list after triangulation split the triangle of half-edges e0 (a->b), e1, e2 by a new point p (see Triangulation::add_point):
+  // the edges of e1 and e2 moved to f0 and g0, and the new edges b-p, c-p, a-p are appended
+  void split (std::vector<size_t> &tri, size_t e0, size_t f0, size_t g0)
+  {
+    size_t e1 = e0 + 1, e2 = e0 + 2;
+
+    halfedge_edge_.resize(tri.size());
+    halfedge_edge_[f0] = halfedge_edge_[e1];
+    halfedge_edge_[g0] = halfedge_edge_[e2];
+    for (auto [h, twin] : { std::make_pair(e1, f0 + 2), std::make_pair(f0 + 1, g0 + 2), std::make_pair(g0 + 1, e2) })
+    {
+      halfedge_edge_[h] = halfedge_edge_[twin] = a_.size();
+      add(tri[h], tri[next_halfedge(h)]);
+    }
+
+    numedges_ = a_.size();
+    length_.resize(numedges_);
+    dist_x_.resize(numedges_);
+    dist_y_.resize(numedges_);
+    force_x_.resize(numedges_);
+    force_y_.resize(numedges_);
+    rest_dist_.resize(numedges_, 1);
+  } // end Edges::split ()
+
+  // update edges [begin, end) after points have moved
+  void update (std::vector<CoordT> &points, int begin, int end)
+  {
+/*  for (auto e: edges_)
+    {
+	e.dist_x = point_[2 * e.b]     - point_[2 * e.a];
+	e.dist_y = point_[2 * e.b + 1] - point_[2 * e.a + 1];
+	e.length = std::sqrt(e.dist_x * e.dist_x + e.dist_y * e.dist_y);
+	CoordT midx = point_[2 * e.a]     + 0.5 * e.dist_x;
+	CoordT midy = point_[2 * e.a + 1] + 0.5 * e.dist_y;
+	h_dist = get_h(midx, midy);
+    }
+*/
+    for (int i = begin; i < end; i++)
+    {
+      dist_x_[i] = points[x(b_[i])] - points[x(a_[i])];
+      dist_y_[i] = points[y(b_[i])] - points[y(a_[i])];
+    }
+    vector_norm(end - begin, dist_x_.data() + begin, dist_y_.data() + begin, length_.data() + begin); // length = sqrt(dist_x ^ 2 + dist_y ^ 2);
+
+    if (density_.is_uniform())
+    { // uniform, rest_dist_ stays 1 from set() unless a density map was used before
+      if constexpr (!DensityT::uniform)
+	std::fill(rest_dist_.begin() + begin, rest_dist_.begin() + end, 1);
+      return;
+    }
+
+    for (int block = begin; block < end; block += 256)
+    { // get middle points of a block of edges and lookup density map
+      CoordT midx[256], midy[256];
+      int    num = std::min(256, end - block);
+
+      for (int i = 0; i < num; i++)
+      {
+	midx[i] = points[x(a_[block + i])] + 0.5 * dist_x_[block + i];
+	midy[i] = points[y(a_[block + i])] + 0.5 * dist_y_[block + i];
+      }
+      density_.sample(num, midx, midy, rest_dist_.data() + block);
+    }
+  } // end Edges::update ()
+
+  // partial sum of scaling factor's target area over edges [begin, end), added to area
+  double target_area (int begin, int end, double area = 0)
+  {
+    for (int i = begin; i < end; i++)
+      area += rest_dist_[i] * rest_dist_[i]; // 1 / h^2
+    return area;
+  }
+
+  // called after setting/updating edges
+  double scaling_factor (double target_area)
+  { /* for point in self.points:
+	   for near in point.near:
+		npair += 1
+		midx ,midy = point.midTo(near)
+		target_area += 1 / self.h_dist(midx, midy)**2 
+      return self.l0_uni * np.sqrt(npair / target_area)
+ */
+     // loop over edges (do over precalculated density h at edges midpoints)
+    // python visits each edge twice (npair and target_area both doubled), which cancels out in the ratio
+    return sqrt(numedges_ / target_area);
+  } // end Edges::scaling_factor ()
+
+  // compute spring repulsive force vectors of edges [begin, end) (first pass, vectorised), rest is the spring rest length for h = 1
+  void compute_forces (double rest, double k, double dt, int begin, int end)
+  {
+    spring_force_kernel<CoordT>(end - begin, dist_x_.data() + begin, dist_y_.data() + begin, length_.data() + begin, rest_dist_.data() + begin,
+				rest, k, dt, force_x_.data() + begin, force_y_.data() + begin);
+  }
+
+  // number of edges of [begin, end) with force (compressed springs), adds squared force magnitudes to sumsq
+  int count_forces (int begin, int end, double &sumsq)
+  {
+    int count = 0;
+    for (int i = begin; i < end; i++)
+    {
+      CoordT f2 = force_x_[i] * force_x_[i] + force_y_[i] * force_y_[i];
+      count += f2 > 0;
+      sumsq += f2;
+    }
+    return count;
+  }
+
+  // apply spring repulsive forces of edges [begin, end) to end points' push vectors (second pass, scatter)
+  void scatter_forces (std::vector<CoordT> &push, int begin, int end)
+  {
+/*  def repulsiveForce(self, f, point):
+        angle = np.arctan2(self.y - point.y, self.x - point.x)
+        self.push_x += f * np.cos(angle)
+        self.push_y += f * np.sin(angle)
+*/
+    for (int i = begin; i < end; i++)
+    { // force is 0 for uncompressed springs, no need to branch
+      push[x(a_[i])] -= force_x_[i];
+      push[y(a_[i])] -= force_y_[i];
+      push[x(b_[i])] += force_x_[i];
+      push[y(b_[i])] += force_y_[i];
+
+#if DEBUG_POLY > 3
+      printf("scatter_forces (%.3f, %.3f) edge %d [%d, %d]\n", force_x_[i], force_y_[i], i, a_[i], b_[i]);
+#endif
+    }
+  }
+}; // end struct Edges
+
+
+///////////////////////////////////////////////////////////////////////////////
+// stable parallel LSD radix sort of NUMKEYS independent arrays of (key, index) pairs, ties keep their input order:
+// start(), fill keys(k) and index(k), then pass() until it returns true (resumable, one digit per call), or sort()
+template<typename Key, int NUMKEYS>
+class RadixSort
+{
+  static constexpr int BITS = 8, BUCKETS = 1 << BITS;
+
+  std::vector<Key>	keys_[NUMKEYS][2];	// per key array: current and scatter target
+  std::vector<int>	index_[NUMKEYS][2];
+  std::vector<int>	hist_;		// per key array, thread and bucket: digit count, then scatter position
+  int			cur_[NUMKEYS] = { 0 };
+  int			num_ = 0, shift_ = 0, keybits_ = 0;
+
+public:
+  // prepare sorting num pairs per key array by their lowest keybits bits
+  void start (int num, int keybits = sizeof(Key) * 8)
+  {
+    num_     = num;
+    shift_   = 0;
+    keybits_ = keybits;
+    for (int k = 0; k < NUMKEYS; k++)
+    {
+      cur_[k] = 0;
+      for (int buf = 0; buf < 2; buf++)
+      {
+	keys_[k][buf].resize(num);
+	index_[k][buf].resize(num);
+      }
+    }
+  }
+
+  // input before the first pass, sorted pairs after the last
+  Key *keys  (int k) { return keys_[k][cur_[k]].data(); }
+  int *index (int k) { return index_[k][cur_[k]].data(); }
+  const std::vector<int> &sorted_index (int k) { return index_[k][cur_[k]]; }
+
+  // sort by the next digit, returns true when sorted
+  bool pass (ThreadPool &pool)
+  {
+    if (shift_ >= keybits_)
+      return true;
+
+    int num = num_, shift = shift_, numthreads = pool.get_num_threads();
+    hist_.resize(NUMKEYS * numthreads * BUCKETS);
+
+    // all key arrays at once: each thread counts the digits of its chunk of each
+    pool.run([&](int thread, int numthreads)
+    {
+      int begin, end;
+      ThreadPool::chunk(num, thread, numthreads, begin, end);
+      for (int k = 0; k < NUMKEYS; k++)
+      {
+	int	  *hist = &hist_[(k * numthreads + thread) * BUCKETS];
+	const Key *keys = keys_[k][cur_[k]].data();
+
+	std::fill(hist, hist + BUCKETS, 0);
+	for (int i = begin; i < end; i++)
+	  hist[(keys[i] >> shift) & (BUCKETS - 1)]++;
+      }
+    });
+
+    // scatter positions: exclusive prefix sum over buckets, then threads, which keeps the order within a bucket;
+    // no scatter for a key array where all keys have the same digit
+    bool scatter[NUMKEYS], any = false;
+    for (int k = 0; k < NUMKEYS; k++)
+    {
+      int pos = 0;
+      scatter[k] = true;
+      for (int bucket = 0; bucket < BUCKETS; bucket++)
+      {
+	int start = pos;
+	for (int t = 0; t < numthreads; t++)
+	{
+	  int &h = hist_[(k * numthreads + t) * BUCKETS + bucket];
+	  int count = h;
+	  h = pos;
+	  pos += count;
+	}
+	if (pos - start == num)
+	  scatter[k] = false;
+      }
+      any |= scatter[k];
+    }
+
+    if (any)
+    {
+      pool.run([&](int thread, int numthreads)
+      {
+	int begin, end;
+	ThreadPool::chunk(num, thread, numthreads, begin, end);
+	for (int k = 0; k < NUMKEYS; k++)
+	  if (scatter[k])
+	  {
+	    int	      *pos   = &hist_[(k * numthreads + thread) * BUCKETS];
+	    const Key *keys  = keys_[k][cur_[k]].data();
+	    const int *index = index_[k][cur_[k]].data();
+	    Key	      *keys_out  = keys_[k][!cur_[k]].data();
+	    int	      *index_out = index_[k][!cur_[k]].data();
+
+	    for (int i = begin; i < end; i++)
+	    {
+	      int p = pos[(keys[i] >> shift) & (BUCKETS - 1)]++;
+	      keys_out[p]  = keys[i];
+	      index_out[p] = index[i];
+	    }
+	  }
+      });
+      for (int k = 0; k < NUMKEYS; k++)
+	cur_[k] ^= scatter[k];
+    }
+
+    shift_ += BITS;
+    return shift_ >= keybits_;
+  } // end RadixSort::pass ()
+
+  void sort (ThreadPool &pool)
+  {
+    while (!pass(pool))
+      ;
+  }
+}; // end class RadixSort
+
+
+///////////////////////////////////////////////////////////////////////////////
+template<typename CoordT>
+struct Triangulation
+{
+  std::vector<CoordT> tripoints_;	// interleaved(!) array of x/y coordinates at triangulation, triangulated in place, need to keep for use in dist_since_triangulation
+  std::vector<size_t> *vertices_ = NULL; // interleaved(!) array of triplets of triangle vertex indices (into tripoints array)
+  DelaunayTriangulator<CoordT> del_;	// persistent triangulator, keeps its buffers
+  int tri_count_ = 0;	// number of triangulation updates, full or incremental
+  int flip_count_ = 0;	// number of edge flips by incremental repair
+
+  // for incremental repair
+  std::vector<size_t> vertex_halfedge_;	// one half-edge starting at each point, INVALID_INDEX for points not in triangulation (duplicates)
+  std::vector<size_t> flip_stack_;	// half-edges to check for delaunay condition, reserved to one entry per half-edge, never grows in repair()
+
+  void init (int num)
+  {
+    tripoints_.reserve(num * 2); // don't init elements, will be overwritten by triangulate()
+    tri_count_ = 0;
+  }
+
+  RadixSort<uint64_t, 1> sort_;	// points by distance from the seed, the bits of a non-negative double order like its value
+
+  void triangulate (ThreadPool &pool, std::vector<CoordT> &points)
+  {
+    start(pool, points);
+    while (!sort(pool))
+      ;
+    insert(points.size() / 2);
+  }
+
+  // resumable full triangulation: start() copies the points, seeds the triangulator and computes the sort keys,
+  // sort() sorts the points by one radix digit and returns true when they are in insertion order,
+  // insert() adds up to count points and returns true when the triangulation is complete
+  void start (ThreadPool &pool, std::vector<CoordT> &points)
+  {
+    tripoints_.assign(points.begin(), points.end()); // snapshot of the input points, stays valid while insertion is resumed
+
+    // call delaunay triangulation, reuses buffers of previous call
+    vertices_ = NULL; // invalid until complete, start might be interrupted by exception
+    int num = tripoints_.size() / 2;
+    del_.seed(tripoints_.data(), num);
+
+    sort_.start(num);
+    uint64_t *keys  = sort_.keys(0);
+    int	     *index = sort_.index(0);
+    pool.parallel_for(num, [&](int begin, int end, int /*thread*/)
+    {
+      for (int i = begin; i < end; i++)
+      {
+	double key = del_.sort_key(i);
+	std::memcpy(&keys[i], &key, sizeof(key));
+	index[i] = i;
+      }
+    });
+  } // end Triangulation::start ()
+
+  bool sort (ThreadPool &pool)
+  {
+    if (!sort_.pass(pool))
+      return false;
+
+    // points at equal distance in delaunator's order: by x, then y (exact duplicates by index)
+    const uint64_t *keys  = sort_.keys(0);
+    const int	   *index = sort_.index(0);
+    std::vector<size_t> &ids = del_.order();
+    size_t num = ids.size();
+    for (size_t i = 0; i < num; )
+    {
+      size_t j = i;
+      for (; j < num  &&  keys[j] == keys[i]; j++)
+	ids[j] = index[j];
+      if (j - i > 1)
+	std::sort(ids.begin() + i, ids.begin() + j, [&](size_t a, size_t b)
+	{
+	  return std::make_tuple(tripoints_[x(a)], tripoints_[y(a)], a) < std::make_tuple(tripoints_[x(b)], tripoints_[y(b)], b);
+	});
+      i = j;
+    }
+    del_.begin_insert();
+    return true;
+  } // end Triangulation::sort ()
+
+  bool insert (size_t count)
+  {
+    if (!del_.insert(count))
+      return false;
+    vertices_ = &del_.triangles_;
+
+    vertex_halfedge_.assign(tripoints_.size() / 2, INVALID_INDEX);
+    for (size_t e = 0; e < vertices_->size(); e++)
+      vertex_halfedge_[(*vertices_)[e]] = e;
+    flip_stack_.reserve(vertices_->size());
+
+    tri_count_++;
+
+#if DEBUG_POLY > 2
+    for (int i = 0; i < vertices_->size(); i += 3)
+    {
+      printf("tri %3d: %3d %3d %3d\n", i / 3, (*vertices_)[i], (*vertices_)[i + 1], (*vertices_)[i + 2]);
+    }
+#endif
+    return true;
+  } // end Triangulation::insert ()
+
+  bool valid () { return vertices_ != NULL  &&  vertex_halfedge_.size() * 2 == tripoints_.size(); }
+
+  // take over a complete triangulation of points, e.g. from a layout cache: numhalf half-edges' start vertices (clockwise triplets)
+  // and opposite half-edges (negative or INVALID_INDEX on the hull)
+  template<typename IndexT>
+  void set (std::vector<CoordT> &points, size_t numhalf, const IndexT *triangles, const IndexT *halfedges)
+  {
+    tripoints_.assign(points.begin(), points.end());
+    del_.triangles_.assign(triangles, triangles + numhalf);
+    del_.halfedges_.resize(numhalf);
+    for (size_t e = 0; e < numhalf; e++)
+      del_.halfedges_[e] = halfedges[e] < 0  ||  (size_t) halfedges[e] >= numhalf  ?  INVALID_INDEX  :  (size_t) halfedges[e];
+    vertices_ = &del_.triangles_;
+
+    vertex_halfedge_.assign(tripoints_.size() / 2, INVALID_INDEX);
+    for (size_t e = 0; e < numhalf; e++)
+      vertex_halfedge_[(*vertices_)[e]] = e;
+    flip_stack_.reserve(numhalf);
+    tri_count_++;
+  } // end Triangulation::set ()
+
+  // triangle of half-edge e is clockwise (not inverted nor degenerate)
+  bool triangle_ok (std::vector<CoordT> &p, size_t e)
+  {
+    std::vector<size_t> &tri = *vertices_;
+    size_t t = e - e % 3;
+    return orient2d(p[x(tri[t])], p[y(tri[t])], p[x(tri[t + 1])], p[y(tri[t + 1])], p[x(tri[t + 2])], p[y(tri[t + 2])]) < 0;
+  }
+
+  // hull is still convex at end point of hull half-edge h (clockwise hull: right turn to next hull half-edge, collinear allowed)
+  bool hull_convex (std::vector<CoordT> &p, size_t h)
+  {
+    std::vector<size_t> &tri = *vertices_;
+    std::vector<size_t> &half = del_.halfedges_;
+    size_t n = next_halfedge(h);	// walk around end point of h to find the following hull half-edge
+    while (half[n] != INVALID_INDEX)
+      n = next_halfedge(half[n]);
+
+    size_t a = tri[h], b = tri[n], c = tri[next_halfedge(n)];
+    return orient2d(p[x(a)], p[y(a)], p[x(b)], p[y(b)], p[x(c)], p[y(c)]) <= 0;
+  }
+
+  // hull half-edge ending at start point of hull half-edge h
+  size_t hull_prev (size_t h)
+  {
+    std::vector<size_t> &half = del_.halfedges_;
+    size_t e = prev_halfedge(h);
+    while (half[e] != INVALID_INDEX)
+      e = prev_halfedge(half[e]);
+    return e;
+  }
+
+  // flip edge of half-edge a and its twin b (same as delaunator's legalize): quad p0, pr, p1, pl with diagonal pr-pl becomes diagonal p0-p1
+  void flip (size_t a, size_t b)
+  {
+    std::vector<size_t> &tri  = *vertices_;
+    std::vector<size_t> &half = del_.halfedges_;
+    size_t al = next_halfedge(a), ar = prev_halfedge(a);
+    size_t bl = prev_halfedge(b), br = next_halfedge(b);
+    size_t p0 = tri[ar], pr = tri[a], pl = tri[al], p1 = tri[bl];
+    size_t hbl = half[bl], har = half[ar];
+
+    tri[a] = p1;
+    tri[b] = p0;
+    half[a] = hbl;  if (hbl != INVALID_INDEX)  half[hbl] = a;
+    half[b] = har;  if (har != INVALID_INDEX)  half[har] = b;
+    half[ar] = bl;
+    half[bl] = ar;
+
+    // a and b no longer start at pr and pl
+    vertex_halfedge_[pr] = br;
+    vertex_halfedge_[pl] = al;
+  }
+
+  // incremental update: repair delaunay condition around points moved more than thresh since last triangulation by lawson edge flips,
+  // calling on_flip(a, b, ar, bl, p0, p1) after each flip
+  // returns false if a full triangulation is needed (inverted triangles, non-convex hull, point missing from triangulation, no convergence,
+  // or so many moved points that the flip stack would outgrow its reserve)
+  template<typename F>
+  bool repair (std::vector<CoordT> &points, double thresh, F &&on_flip)
+  {
+    std::vector<size_t> &half = del_.halfedges_;
+    const size_t invalid = INVALID_INDEX;
+    int numpoints = points.size() / 2;
+
+    flip_stack_.clear();
+
+    // collect half-edges of triangles around moved points, check validity of triangulation there
+    for (int i = 0; i < numpoints; i++)
+    {
+      double dx = (double) points[x(i)] - tripoints_[x(i)];
+      double dy = (double) points[y(i)] - tripoints_[y(i)];
+      if (dx * dx + dy * dy <= thresh * thresh)
+	continue;
+
+      size_t start = vertex_halfedge_[i];
+      if (start == invalid)
+	return false;
+
+      // walk clockwise around point i over outgoing half-edges, then counter-clockwise if we hit the hull
+      size_t e = start;
+      bool   hull = false;
+      do {
+	if (!triangle_ok(points, e)  ||  flip_stack_.size() + 2 > flip_stack_.capacity())
+	  return false;
+	flip_stack_.push_back(next_halfedge(e)); // opposite edge
+	flip_stack_.push_back(e);
+
+	size_t in = prev_halfedge(e);
+	if (half[in] == invalid)
+	{ // incoming hull edge: check convexity at i and before
+	  if (!hull_convex(points, in)  ||  !hull_convex(points, hull_prev(in)))
+	    return false;
+	  hull = true;
+	  break;
+	}
+	e = half[in];
+      } while (e != start);
+
+      for (e = start; hull  &&  half[e] != invalid; )
+      {
+	e = next_halfedge(half[e]);
+	if (!triangle_ok(points, e)  ||  flip_stack_.size() + 2 > flip_stack_.capacity())
+	  return false;
+	flip_stack_.push_back(next_halfedge(e));
+	flip_stack_.push_back(e);
+      }
+      if (hull  &&  !hull_convex(points, e)) // outgoing hull edge: check convexity after i
+	return false;
+
+      tripoints_[x(i)] = points[x(i)]; // only moved points count as updated, others keep accumulating displacement
+      tripoints_[y(i)] = points[y(i)];
+    }
+
+    if (!legalize(points, on_flip))
+      return false;
+    tri_count_++;
+    return true;
+  } // end Triangulation::repair ()
+
+  // quad of half-edge a and its twin b is strictly convex, so that the edge can be flipped
+  bool flippable (std::vector<CoordT> &points, size_t a, size_t b)
+  {
+    std::vector<size_t> &tri = *vertices_;
+    size_t p0 = tri[prev_halfedge(a)], pr = tri[a], pl = tri[next_halfedge(a)], p1 = tri[prev_halfedge(b)];
+
+    return orient2d(points[x(p1)], points[y(p1)], points[x(pl)], points[y(pl)], points[x(p0)], points[y(p0)]) < 0  &&
+	   orient2d(points[x(p0)], points[y(p0)], points[x(pr)], points[y(pr)], points[x(p1)], points[y(p1)]) < 0;
+  }
+
+  // lawson flips: flip edges on flip_stack_ not fulfilling the delaunay condition, then check the 4 outer edges of the flipped quad,
+  // returns false if not converged or the stack would outgrow its reserve; with a margin, edges whose opposite point is inside the
+  // circumcircle by at most margin (incircle determinant, in length^4) are kept, so that a nearly cocircular quad isn't flipped back and forth
+  template<typename F>
+  bool legalize (std::vector<CoordT> &points, F &&on_flip, double margin = 0)
+  {
+    std::vector<size_t> &tri  = *vertices_;
+    std::vector<size_t> &half = del_.halfedges_;
+    int maxflips = tri.size();
+    int numflips = 0;
+
+    while (!flip_stack_.empty())
+    {
+      size_t a = flip_stack_.back();
+      size_t b = half[a];
+      flip_stack_.pop_back();
+
+      if (b == INVALID_INDEX)
+	continue;
+
+      size_t al = next_halfedge(a), ar = prev_halfedge(a);
+      size_t bl = prev_halfedge(b), br = next_halfedge(b);
+      size_t p0 = tri[ar], pr = tri[a], pl = tri[al], p1 = tri[bl];
+
+      if (incircle(points[x(p0)], points[y(p0)], points[x(pr)], points[y(pr)], points[x(pl)], points[y(pl)], points[x(p1)], points[y(p1)]) >= -margin)
+	continue;	// p1 not in circumcircle: legal
+      if (!flippable(points, a, b))
+	continue;	// quad not convex: can't flip
+
+      flip(a, b);
+      on_flip(a, b, ar, bl, (int) p0, (int) p1);
+
+      if (++numflips > maxflips  ||  flip_stack_.size() + 4 > flip_stack_.capacity())
+	return false;
+
+      flip_stack_.push_back(a);
+      flip_stack_.push_back(al);
+      flip_stack_.push_back(b);
+      flip_stack_.push_back(br);
+    }
+
+    flip_count_ += numflips;
+    return true;
+  } // end Triangulation::legalize ()
+
+  void link (size_t a, size_t b)
+  {
+    del_.halfedges_[a] = b;
+    if (b != INVALID_INDEX)
+      del_.halfedges_[b] = a;
+  }
+
+  // insert point p (already appended to points) strictly inside the triangle of half-edge e by splitting it into three,
+  // calling on_split(e0, f0, g0) after the split (see below), and restore the delaunay condition, calling on_flip() after each flip,
+  // returns false if the triangle is inverted or flips don't converge
+  template<typename S, typename F>
+  bool add_point (std::vector<CoordT> &points, int p, size_t e, S &&on_split, F &&on_flip)
+  {
+    std::vector<size_t> &tri  = *vertices_;
+    std::vector<size_t> &half = del_.halfedges_;
+
+    tripoints_.resize(points.size());
+    tripoints_[x(p)] = points[x(p)];
+    tripoints_[y(p)] = points[y(p)];
+    vertex_halfedge_.resize(points.size() / 2, INVALID_INDEX);
+    if (!triangle_ok(points, e))
+      return false;
+
+    // triangle a, b, c (half-edges e0 a->b, e1 b->c, e2 c->a) becomes a, b, p and new triangles b, c, p (f0 b->c) and c, a, p (g0 c->a)
+    size_t e0 = e - e % 3, e1 = e0 + 1, e2 = e0 + 2;
+    size_t a = tri[e0], b = tri[e1], c = tri[e2];
+    size_t h1 = half[e1], h2 = half[e2];
+    size_t f0 = tri.size(), g0 = f0 + 3;
+
+    tri[e2] = p;
+    tri.insert(tri.end(), { b, c, (size_t) p, c, a, (size_t) p });
+    half.resize(tri.size());
+    link(f0, h1);
+    link(g0, h2);
+    link(e1, f0 + 2);	  // b->p, p->b
+    link(f0 + 1, g0 + 2); // c->p, p->c
+    link(g0 + 1, e2);	  // a->p, p->a
+
+    vertex_halfedge_[a] = e0;
+    vertex_halfedge_[b] = f0;
+    vertex_halfedge_[c] = g0;
+    vertex_halfedge_[p] = e2;
+    on_split(e0, f0, g0);
+
+    flip_stack_.clear();
+    flip_stack_.push_back(e0);
+    flip_stack_.push_back(f0);
+    flip_stack_.push_back(g0);
+    tri_count_++;
+    return legalize(points, on_flip);
+  } // end Triangulation::add_point ()
+
+  // call f(e) for each outgoing half-edge e of point v: walk clockwise, and counter-clockwise from the start if we hit the hull,
+  // returns false if v is on the hull or not in the triangulation
+  template<typename F>
+  bool around (int v, F &&f)
+  {
+    std::vector<size_t> &half = del_.halfedges_;
+    size_t start = vertex_halfedge_[v], e = start;
+    bool   inner = true;
+
+    if (start == INVALID_INDEX)
+      return false;
+    do {
+      f(e);
+      if (half[prev_halfedge(e)] == INVALID_INDEX)
+      {
+	inner = false;
+	for (e = start; half[e] != INVALID_INDEX; )
+	{
+	  e = next_halfedge(half[e]);
+	  f(e);
+	}
+	break;
+      }
+      e = half[prev_halfedge(e)];
+    } while (e != start);
+    return inner;
+  } // end Triangulation::around ()
+
+  // all triangles around point v are clockwise
+  bool star_ok (std::vector<CoordT> &points, int v)
+  {
+    bool ok = true;
+    around(v, [&](size_t e) { ok = ok  &&  triangle_ok(points, e); });
+    return ok;
+  }
+
+  // remove interior point v: flip its edges away until it has degree 3, then merge its three triangles into one and flag the other two in dead,
+  // and restore the delaunay condition, returns false for points on the hull or not in the triangulation
+  bool remove_point (std::vector<CoordT> &points, int v, std::vector<char> &dead)
+  {
+    std::vector<size_t> &tri  = *vertices_;
+    std::vector<size_t> &half = del_.halfedges_;
+
+    flip_stack_.clear();
+    dead.resize(tri.size() / 3);
+
+    while (true)
+    { // walk around v over outgoing half-edges, count them and find one that can be flipped away
+      size_t start = vertex_halfedge_[v];
+      size_t e = start, flip_e = INVALID_INDEX;
+      int    degree = 0;
+
+      if (start == INVALID_INDEX)
+	return false;
+      do {
+	if (half[e] == INVALID_INDEX  ||  half[prev_halfedge(e)] == INVALID_INDEX)
+	  return false;	// on hull
+	if (flip_e == INVALID_INDEX  &&  flippable(points, e, half[e]))
+	  flip_e = e;
+	degree++;
+	e = half[prev_halfedge(e)];
+      } while (e != start);
+
+      if (degree <= 3)
+	break;
+      if (flip_e == INVALID_INDEX)
+	return false;
+
+      size_t b = half[flip_e];
+      flip(flip_e, b);	// new diagonal ar/bl doesn't touch v
+      flip_stack_.push_back(flip_e);
+      flip_stack_.push_back(next_halfedge(flip_e));
+      flip_stack_.push_back(prev_halfedge(flip_e));
+      flip_stack_.push_back(b);
+      flip_stack_.push_back(next_halfedge(b));
+    }
+
+    // merge triangles (v, w1, w2), (v, w2, w3), (v, w3, w1) into (w1, w2, w3) in the slot of the first
+    size_t e1 = vertex_halfedge_[v], e2 = half[prev_halfedge(e1)], e3 = half[prev_halfedge(e2)];
+    size_t o[3] = { half[next_halfedge(e1)], half[next_halfedge(e2)], half[next_halfedge(e3)] };
+    size_t w[3] = { tri[next_halfedge(e1)],  tri[next_halfedge(e2)],  tri[next_halfedge(e3)] };
+    size_t t = e1 - e1 % 3;
+
+    for (int k = 0; k < 3; k++)
+    {
+      tri[t + k] = w[k];
+      link(t + k, o[k]);
+      vertex_halfedge_[w[k]] = t + k;
+      flip_stack_.push_back(t + k);
+    }
+    vertex_halfedge_[v] = INVALID_INDEX;
+    dead[e2 / 3] = dead[e3 / 3] = 1;
+
+    flip_stack_.erase(std::remove_if(flip_stack_.begin(), flip_stack_.end(), [&](size_t h) { return dead[h / 3]; }), flip_stack_.end());
+    tri_count_++;
+    return legalize(points, [](size_t, size_t, size_t, size_t, int, int) { });
+  } // end Triangulation::remove_point ()
+
+  // after remove_point(): move last live triangles into dead slots, renumber vertices by remap (new index, -1 for removed points)
+  void compact (std::vector<char> &dead, const std::vector<int> &remap, int numpoints)
+  {
+    std::vector<size_t> &tri  = *vertices_;
+    std::vector<size_t> &half = del_.halfedges_;
+    size_t numtri = tri.size() / 3, hole = 0;
+
+    dead.resize(numtri);
+    while (true)
+    {
+      while (numtri > 0  &&  dead[numtri - 1])
+	numtri--;
+      while (hole < numtri  &&  !dead[hole])
+	hole++;
+      if (hole >= numtri)
+	break;
+
+      for (size_t k = 0; k < 3; k++)
+      {
+	tri[3 * hole + k] = tri[3 * (numtri - 1) + k];
+	link(3 * hole + k, half[3 * (numtri - 1) + k]);
+      }
+      dead[hole] = 0;
+      numtri--;
+    }
+    tri.resize(3 * numtri);
+    half.resize(3 * numtri);
+    dead.clear();
+
+    for (size_t &v : tri)
+      v = remap[v];
+    for (size_t i = 0; i < remap.size(); i++)
+      if (remap[i] >= 0)
+      {
+	tripoints_[x(remap[i])] = tripoints_[x(i)];
+	tripoints_[y(remap[i])] = tripoints_[y(i)];
+      }
+    tripoints_.resize(numpoints * 2);
+
+    vertex_halfedge_.assign(numpoints, INVALID_INDEX);
+    for (size_t e = 0; e < tri.size(); e++)
+      vertex_halfedge_[tri[e]] = e;
+  } // end Triangulation::compact ()
+
+  std::vector<size_t> &get_vertices() { return *vertices_; }
+  std::vector<size_t> &get_halfedges() { return del_.halfedges_; }
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// rank transform of both coordinate columns of interleaved points: radix sort of (key, index) pairs per axis,
+// keys are the float bit patterns made order-preserving, ties keep ascending point index
+template<typename CoordT>
+class RankTransform
+{
+  using Key = typename std::conditional<sizeof(CoordT) == 8, uint64_t, uint32_t>::type;
+
+  RadixSort<Key, 2> sort_;
+
+  // flip sign bit of positive, all bits of negative numbers, so that unsigned order is float order (-0 counts as +0)
+  static Key ordered (CoordT v)
+  {
+    Key bits;
+    v += 0;
+    std::memcpy(&bits, &v, sizeof(Key));
+    return bits ^ ((bits >> (sizeof(Key) * 8 - 1))  ?  ~Key(0)  :  Key(1) << (sizeof(Key) * 8 - 1));
+  }
+
+public:
+  // call out(axis, rank, point index) for each point and axis, rank being the position in ascending order of its coordinate (from all threads)
+  template<typename F>
+  void rank (ThreadPool &pool, const std::vector<CoordT> &points, int num, F &&out)
+  {
+    sort_.start(num);
+    pool.parallel_for(num, [&](int begin, int end, int /*thread*/)
+    {
+      for (int axis = 0; axis < 2; axis++)
+	for (int i = begin; i < end; i++)
+	{
+	  sort_.keys(axis)[i]  = ordered(points[i * 2 + axis]);
+	  sort_.index(axis)[i] = i;
+	}
+    });
+
+    sort_.sort(pool);
+
+    pool.parallel_for(num, [&](int begin, int end, int /*thread*/)
+    {
+      for (int axis = 0; axis < 2; axis++)
+	for (int i = begin; i < end; i++)
+	  out(axis, i, sort_.index(axis)[i]);
+    });
+  } // end RankTransform::rank ()
+}; // end class RankTransform
+
+
+///////////////////////////////////////////////////////////////////////////////
+// spatial order of interleaved points along a hilbert curve through a 2^16 x 2^16 grid over their bounding box:
+// radix sort of (curve index, point index) pairs, ties keep ascending point index
+template<typename CoordT>
+class HilbertOrder
+{
+  static constexpr int ORDER = 16;
+
+  RadixSort<uint32_t, 1> sort_;
+  CoordT		 xmin_ = 0, ymin_ = 0;	// grid origin and scale of last start()
+  double		 sx_ = 0, sy_ = 0;
+
+  // distance of cell (cx, cy) along the curve (xy2d of https://en.wikipedia.org/wiki/Hilbert_curve)
+  static uint32_t curve_index (uint32_t cx, uint32_t cy)
+  {
+    uint32_t d = 0;
+    for (uint32_t s = 1u << (ORDER - 1); s > 0; s >>= 1)
+    {
+      uint32_t rx = (cx & s) > 0, ry = (cy & s) > 0;
+      d += s * s * ((3 * rx) ^ ry);
+
+      // rotate quadrant without branches (they are unpredictable): if ry == 0, flip if rx == 1, then swap;
+      // only the bits below s matter further on, where s - 1 - c == (s - 1) ^ c
+      uint32_t flip = (s - 1) & (0u - (rx & (ry ^ 1)));
+      uint32_t swap = (cx ^ cy) & (ry - 1);
+      cx ^= flip ^ swap;
+      cy ^= flip ^ swap;
+    }
+    return d;
+  }
+
+public:
+  // resumable: start() takes the bounding box of points [0, num), index() computes the curve indices of a range of them,
+  // pass() sorts by one digit and returns true when done, result() is then the point indices sorted along the curve, valid until next start()
+  void start (const std::vector<CoordT> &points, int num)
+  {
+    CoordT xmin = FLT_MAX, ymin = FLT_MAX, xmax = -FLT_MAX, ymax = -FLT_MAX;
+    for (int i = 0; i < num; i++)
+    {
+      xmin = std::min(xmin, points[x(i)]);
+      xmax = std::max(xmax, points[x(i)]);
+      ymin = std::min(ymin, points[y(i)]);
+      ymax = std::max(ymax, points[y(i)]);
+    }
+    double cells = (1 << ORDER) - 1;
+    xmin_ = xmin;
+    ymin_ = ymin;
+    sx_ = xmax > xmin  ?  cells / (xmax - xmin)  :  0;
+    sy_ = ymax > ymin  ?  cells / (ymax - ymin)  :  0;
+    sort_.start(num, 2 * ORDER);
+  } // end HilbertOrder::start ()
+
+  void index (ThreadPool &pool, const std::vector<CoordT> &points, int begin, int end)
+  {
+    uint32_t *keys  = sort_.keys(0);
+    int	     *index = sort_.index(0);
+    pool.parallel_for(end - begin, [&](int b, int e, int /*thread*/)
+    {
+      for (int i = begin + b; i < begin + e; i++)
+      {
+	keys[i]  = curve_index((uint32_t) ((points[x(i)] - xmin_) * sx_), (uint32_t) ((points[y(i)] - ymin_) * sy_));
+	index[i] = i;
+      }
+    });
+  }
+
+  bool pass (ThreadPool &pool) { return sort_.pass(pool); }
+
+  const std::vector<int> &result () { return sort_.sorted_index(0); }
+}; // end class HilbertOrder
+
+
+///////////////////////////////////////////////////////////////////////////////
+template<typename CoordT>
+struct Points
+{
+  int numpoints_ = 0;
+  std::vector<CoordT> points_;	// normalised interleaved point coords 0..1, created by pre-uniformisation
+  std::vector<CoordT> push_;	// interleaved displacement vector x/y
+  std::vector<CoordT> uni_points_;	// interleaved point coords after uniformisation, base for attractors
+  std::vector<CoordT> orig_points_;	// interleaved original point coords (descriptor space), for interpolation in get()
+  std::vector<int>    offsets_;		// start index of each block of last get()
+  std::vector<int>    cellstart_, cellpoints_;	// grid for nearest_original()
+  RankTransform<CoordT> ranker_;	// for pre_uniformize(), keeps its buffers
+
+  // spatial order: after reorder_resume(), points are numbered along a hilbert curve, the caller's order is kept by the index maps
+  std::vector<int>    order_;		// caller's index of each point, empty while points are in caller's order
+  std::vector<int>    inverse_;		// point index of each caller's index
+  HilbertOrder<CoordT> hilbert_;
+  std::vector<CoordT> permute_scratch_[4];	// reordered points_, push_, orig_points_, uni_points_ until swapped in
+  std::vector<int>    order_scratch_;
+  int		      reorder_step_ = 0, reorder_pos_ = 0;	// next step of reorder_resume(), progress of chunked step
+
+  // original bounds before normalisation
+  std::vector<CoordT> bounds_min_{0, 0};
+  std::vector<CoordT> bounds_range_{1, 1};
+  std::vector<CoordT> scaled_points_;	// interleaved points scaled back from normalised coords 0..1 to original bounds
+
+  void get_bounds (std::vector<CoordT> &bounds_min, std::vector<CoordT> &bounds_range)
+  {
+    bounds_min   = bounds_min_;
+    bounds_range = bounds_range_;
+  }
+
+  // scaled back to original bounds in caller's order, else the normalised points in internal order
+  std::vector<CoordT> &get_points_interleaved (bool scaled = false)
+  {
+    if (scaled)
+    {
+      scaled_points_.resize(numpoints_ * 2);
+      get_scaled(scaled_points_.data());
+      return scaled_points_;
+    }
+    else
+      return points_;
+  } // end Points::get_points_interleaved ()
+
+  // write interleaved points scaled back to original bounds to out, in caller's order
+  void get_scaled (CoordT *out)
+  {
+    for (int i = 0; i < numpoints_; i++)
+    {
+      int c = caller_index(i);
+      out[x(c)] = points_[x(i)] * bounds_range_[0] + bounds_min_[0];
+      out[y(c)] = points_[y(i)] * bounds_range_[1] + bounds_min_[1];
+    }
+  }
+
+  // write interleaved normalised points to out, in caller's order
+  void get_normalised (CoordT *out)
+  {
+    for (int i = 0; i < numpoints_; i++)
+    {
+      int c = caller_index(i);
+      out[x(c)] = points_[x(i)];
+      out[y(c)] = points_[y(i)];
+    }
+  }
+
+  // write interleaved original point coords to out, in caller's order
+  void get_original (CoordT *out)
+  {
+    for (int i = 0; i < numpoints_; i++)
+    {
+      int c = caller_index(i);
+      out[x(c)] = orig_points_[x(i)];
+      out[y(c)] = orig_points_[y(i)];
+    }
+  }
+
+  bool reordered () { return !order_.empty(); }
+  int  caller_index (int i) { return order_.empty()  ?  i  :  order_[i]; }
+  int  point_index (int c)  { return order_.empty()  ?  c  :  inverse_[c]; }
+
+  // map point indices (e.g. triangle vertices) to caller's indices in place
+  void caller_indices (std::vector<size_t> &indices)
+  {
+    if (!order_.empty())
+      for (size_t &i : indices)
+	i = order_[i];
+  }
+
+  // renumber points along a hilbert curve through their current positions, for memory locality of the loops over edges' end points;
+  // resumable: reorder_start(), then reorder_resume() until it returns true, each call computes the curve indices of up to chunk points
+  // or does one pass over the points; the point arrays are permuted into scratch and only swapped in by the last call, so the points
+  // stay consistent in between; reorder_permutation() is then the permutation (point i was point perm[i]) for other per-point arrays,
+  // valid until next reorder
+  void reorder_start ()
+  {
+    hilbert_.start(points_, numpoints_);
+    reorder_step_ = 0;
+    reorder_pos_  = 0;
+  }
+
+  bool reorder_resume (ThreadPool &pool, size_t chunk)
+  {
+    std::vector<CoordT> *arrays[4] = { &points_, &push_, &orig_points_, &uni_points_ };
+    const std::vector<int> &perm = hilbert_.result();
+    int step = reorder_step_++;
+
+    if (step == 0)
+    { // curve indices, in chunks
+      int end = (int) std::min<size_t>(numpoints_, reorder_pos_ + std::min<size_t>(chunk, numpoints_));
+      hilbert_.index(pool, points_, reorder_pos_, end);
+      reorder_pos_ = end;
+      if (end < numpoints_)
+	reorder_step_ = 0;
+    }
+    else if (step == 1)
+    { // sort by curve index, one digit per call
+      if (!hilbert_.pass(pool))
+	reorder_step_ = 1;
+    }
+    else if (step <= 5)
+    {
+      if ((int) arrays[step - 2]->size() == 2 * numpoints_)
+	gather_interleaved(perm, *arrays[step - 2], permute_scratch_[step - 2]);
+    }
+    else if (step == 6)
+    {
+      order_scratch_.resize(numpoints_);
+      for (int i = 0; i < numpoints_; i++)
+	order_scratch_[i] = caller_index(perm[i]);
+    }
+    else
+    {
+      for (int k = 0; k < 4; k++)
+	if ((int) arrays[k]->size() == 2 * numpoints_)
+	  arrays[k]->swap(permute_scratch_[k]);
+      order_.swap(order_scratch_);
+      inverse_.resize(numpoints_);
+      for (int i = 0; i < numpoints_; i++)
+	inverse_[order_[i]] = i;
+      return true;
+    }
+    return false;
+  } // end Points::reorder_resume ()
+
+  const std::vector<int> &reorder_permutation () { return hilbert_.result(); }
+
+  void init (int num)
+  {
+    numpoints_ = num;
+    points_.resize(num * 2);
+    push_.resize(num * 2);
+  }
+
+  void set (int numtotal, int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int colx, int coly)
+  {
+    CoordT xmin =  FLT_MAX, ymin =  FLT_MAX;
+    CoordT xmax = -FLT_MAX, ymax = -FLT_MAX;
+    
+    numpoints_ = numtotal;
+    points_.resize(2 * numtotal);
+    push_.resize(2 * numtotal);
+
+    // copy from blocks into interleaved vector and get min/max x/y
+    blockwise(numbuffers, bufsizes, buffers,
+	      [&](int bufsize, CoordT *buffer, int offset) -> void
+	      {
+		copy_with_strides(bufsize, buffer + colx, bufwidth, points_.data() + offset * 2,     2, xmin, xmax);
+		copy_with_strides(bufsize, buffer + coly, bufwidth, points_.data() + offset * 2 + 1, 2, ymin, ymax);
+	      });
+
+    bounds_min_[0] = xmin;
+    bounds_min_[1] = ymin;
+    bounds_range_[0] = xmax - xmin;
+    bounds_range_[1] = ymax - ymin;
+    orig_points_ = points_;
+    order_.clear();
+    inverse_.clear();
+  } // end Points::set ()
+
+  // append points from blocks, only their original coords are set, placing is up to the caller
+  void append (int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int colx, int coly)
+  {
+    int    numold = numpoints_;
+    CoordT dummy  = 0;
+
+    numpoints_ += std::accumulate(bufsizes, bufsizes + numbuffers, 0);
+    points_.resize(2 * numpoints_);
+    push_.resize(2 * numpoints_);
+    orig_points_.resize(2 * numpoints_);
+    blockwise(numbuffers, bufsizes, buffers,
+	      [&](int bufsize, CoordT *buffer, int offset) -> void
+	      {
+		copy_with_strides(bufsize, buffer + colx, bufwidth, orig_points_.data() + (numold + offset) * 2,     2, dummy, dummy);
+		copy_with_strides(bufsize, buffer + coly, bufwidth, orig_points_.data() + (numold + offset) * 2 + 1, 2, dummy, dummy);
+	      });
+    for (int i = numold; i < numpoints_  &&  !order_.empty(); i++)
+    { // appended points get the next caller's indices
+      order_.push_back(i);
+      inverse_.push_back(i);
+    }
+  }
+
+  // positions of points indices[0, num) of all, for a coarse level of the multilevel solver
+  void set_subset (const Points &all, const int *indices, int num)
+  {
+    numpoints_ = num;
+    points_.resize(2 * num);
+    push_.assign(2 * num, 0);
+    uni_points_.clear();
+    order_.clear();
+    inverse_.clear();
+    for (int i = 0; i < num; i++)
+    {
+      points_[x(i)] = all.points_[x(indices[i])];
+      points_[y(i)] = all.points_[y(indices[i])];
+    }
+    bounds_min_   = all.bounds_min_;
+    bounds_range_ = all.bounds_range_;
+  }
+
+  // remove points by remap (new index, -1 for removed points), keeping the order of the others, also in caller's order
+  void remove (const std::vector<int> &remap, int numremain)
+  {
+    if (!order_.empty())
+    { // renumber remaining caller's indices by rank, inverse_ temporarily maps caller's index to new caller's index
+      int rank = 0;
+      for (int c = 0; c < numpoints_; c++)
+	inverse_[c] = remap[inverse_[c]] >= 0  ?  rank++  :  -1;
+      for (int i = 0; i < numpoints_; i++)
+	if (remap[i] >= 0)
+	  order_[remap[i]] = inverse_[order_[i]];
+      order_.resize(numremain);
+      inverse_.resize(numremain);
+      for (int i = 0; i < numremain; i++)
+	inverse_[order_[i]] = i;
+    }
+
+    for (int i = 0; i < numpoints_; i++)
+      if (remap[i] >= 0)
+	for (auto *vec : { &points_, &push_, &orig_points_, &uni_points_ })
+	  if ((int) vec->size() == 2 * numpoints_)
+	  {
+	    (*vec)[x(remap[i])] = (*vec)[x(i)];
+	    (*vec)[y(remap[i])] = (*vec)[y(i)];
+	  }
+
+    for (auto *vec : { &points_, &push_, &orig_points_, &uni_points_ })
+      if ((int) vec->size() == 2 * numpoints_)
+	vec->resize(2 * numremain);
+    numpoints_ = numremain;
+  }
+
+  // for each of the points [first, first + count), the index of the nearest point of [0, num) in original coords relative to bounds
+  void nearest_original (int first, int count, int num, int *nearest)
+  {
+    nearest_original(count, [&](int k) { return first + k; }, num, [](int k) { return k; }, nearest);
+  }
+
+  // for each of count query points query(k), the index of the nearest of num candidate points candidate(k) in original coords relative to bounds,
+  // by ring search on a grid of about one candidate per cell (counting sort of point indices by cell)
+  template<typename Q, typename C>
+  void nearest_original (int count, Q &&query, int num, C &&candidate, int *nearest)
+  {
+    int    g = std::max(1, (int) std::sqrt((double) num));
+    CoordT sx = bounds_range_[0] > 0  ?  1 / bounds_range_[0]  :  1;
+    CoordT sy = bounds_range_[1] > 0  ?  1 / bounds_range_[1]  :  1;
+    auto   cell = [&](CoordT u) { return std::min(std::max((int) (u * g), 0), g - 1); };
+    auto   ux = [&](int i) { return (orig_points_[x(i)] - bounds_min_[0]) * sx; };
+    auto   uy = [&](int i) { return (orig_points_[y(i)] - bounds_min_[1]) * sy; };
+
+    cellstart_.assign(g * g + 1, 0);
+    cellpoints_.resize(num);
+    for (int k = 0; k < num; k++)
+      cellstart_[cell(uy(candidate(k))) * g + cell(ux(candidate(k))) + 1]++;
+    std::partial_sum(cellstart_.begin(), cellstart_.end(), cellstart_.begin());
+    for (int k = 0; k < num; k++)
+      cellpoints_[cellstart_[cell(uy(candidate(k))) * g + cell(ux(candidate(k)))]++] = candidate(k);
+    for (int c = g * g; c > 0; c--) // undo increments
+      cellstart_[c] = cellstart_[c - 1];
+    cellstart_[0] = 0;
+
+    for (int k = 0; k < count; k++)
+    {
+      int    p = query(k);
+      CoordT px = ux(p), py = uy(p), best = std::numeric_limits<CoordT>::max();
+      int    cx = cell(px), cy = cell(py);
+
+      nearest[k] = num > 0  ?  candidate(0)  :  0;
+      for (int r = 0; r <= g; r++)
+      { // cells of ring r around cx, cy, the ones beyond are at least r cells away
+	for (int iy = std::max(cy - r, 0); iy <= std::min(cy + r, g - 1); iy++)
+	  for (int ix = std::max(cx - r, 0); ix <= std::min(cx + r, g - 1); ix++)
+	  {
+	    if (std::abs(ix - cx) != r  &&  std::abs(iy - cy) != r)
+	      continue;
+	    for (int j = cellstart_[iy * g + ix]; j < cellstart_[iy * g + ix + 1]; j++)
+	    {
+	      int    i = cellpoints_[j];
+	      CoordT dx = ux(i) - px, dy = uy(i) - py;
+	      if (dx * dx + dy * dy < best)
+	      {
+		best = dx * dx + dy * dy;
+		nearest[k] = i;
+	      }
+	    }
+	  }
+	if (best <= (CoordT) (r * r) / (g * g))
+	  break;
+      }
+    }
+  } // end Points::nearest_original ()
+
+  // write points scaled back to original bounds into columns outcolx/outcoly of blocks, in one pass and in parallel over points,
+  // interpolated between the uniformised (interp = 0) and original positions (interp = 1), like python's export(interp)
+  void get (int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int outcolx, int outcoly, CoordT interp, ThreadPool &pool)
+  {
+    offsets_.resize(numbuffers + 1);
+    offsets_[0] = 0;
+    for (int b = 0; b < numbuffers; b++)
+      offsets_[b + 1] = offsets_[b] + bufsizes[b];
+
+    int num = std::min(offsets_[numbuffers], numpoints_);
+    const CoordT *orig = interp != 0  ?  orig_points_.data()  :  NULL;
+    CoordT scale[2] = { bounds_range_[0] * (1 - interp), bounds_range_[1] * (1 - interp) };
+    CoordT shift[2] = { bounds_min_[0]   * (1 - interp), bounds_min_[1]   * (1 - interp) };
+
+    pool.parallel_for(num, [&](int begin, int end, int /*thread*/)
+    { // find block containing begin, then write range block by block
+      int b = std::upper_bound(offsets_.begin(), offsets_.begin() + numbuffers, begin) - offsets_.begin() - 1;
+
+      for (int i = begin; i < end; b++)
+      {
+	int     count = std::min(end, offsets_[b + 1]) - i;
+	CoordT *dest  = buffers[b] + (i - offsets_[b]) * bufwidth;
+
+	if (order_.empty())
+	{
+	  scale_with_strides(count, points_.data() + x(i), 2, orig ? orig + x(i) : NULL, scale[0], shift[0], interp, dest + outcolx, bufwidth);
+	  scale_with_strides(count, points_.data() + y(i), 2, orig ? orig + y(i) : NULL, scale[1], shift[1], interp, dest + outcoly, bufwidth);
+	}
+	else
+	{ // rows are caller's indices
+	  scale_gather(count, inverse_.data() + i, points_.data(),     orig, scale[0], shift[0], interp, dest + outcolx, bufwidth);
+	  scale_gather(count, inverse_.data() + i, points_.data() + 1, orig ? orig + 1 : NULL, scale[1], shift[1], interp, dest + outcoly, bufwidth);
+	}
+	i += count;
+      }
+    });
+  } // end Points::get ()
+  
+  CoordT pre_uniformize (Region<CoordT> &region, ThreadPool &pool)
+  { // replace points (in descriptor coordinates) by normalised sort index
+
+    // get inbox for generating pre-uniformised coords
+    CoordT p1[2], p2[2], len[2];
+    region.get_inbox(p1, p2);
+    len[0] = p2[0] - p1[0];
+    len[1] = p2[1] - p1[1];
+
+#if DEBUG_POLY
+    printf("pre_uniformize inbox (%f, %f) (%f, %f)\n", p1[0], p1[1], p2[0], p2[1]);
+#endif
+    
+    // replace coordinates by their rank, scaled to the inbox (ranks are complete before points are overwritten)
+    ranker_.rank(pool, points_, numpoints_, [&](int axis, int rank, int index)
+    {
+      points_[index * 2 + axis] = ((CoordT) rank / (numpoints_ - 1)) * len[axis] + p1[axis];
+    });
+
+    return len[1]; // return y dimension of inbox
+  } // end Points::pre_uniformize ()
+  
+  // move points [begin, end) by push vector
+  void update (int begin, int end)
+  {
+#if DEBUG_POLY > 1
+    for (int i = begin; i < end; i++)
+      printf("up %3d (%.3f, %.3f) push (%.3f, %.3f)\n", i, points_[x(i)], points_[y(i)], push_[x(i)], push_[y(i)]);
+#endif
+    
+    for (int i = x(begin); i < x(end); i++)
+      points_[i] += push_[i];    // points_ += push_;
+  }
+
+  void end_iteration (int begin, int end)
+  { // set push vector of points [begin, end) to zero
+    std::fill(push_.begin() + x(begin), push_.begin() + x(end), 0);
+  }
+  
+  // max squared displacement of points of [begin, end) not flagged as outside, branch-free
+  CoordT max_moved_inside (int begin, int end, const char *outside)
+  {
+    CoordT maxdist = 0;
+    for (int i = begin; i < end; i++)
+    {
+      CoordT dist = outside[i - begin]  ?  0  :  push_[x(i)] * push_[x(i)] + push_[y(i)] * push_[y(i)];
+      maxdist = std::max(maxdist, dist);
+    }
+    return maxdist;
+  }
+
+  // sum of displacement of points of [begin, end) not flagged as outside, and number of those flagged
+  double sum_moved_inside (int begin, int end, const char *outside, int &numoutside)
+  {
+    double sum = 0;
+    for (int i = begin; i < end; i++)
+      if (outside[i - begin])
+	numoutside++;
+      else
+	sum += std::sqrt(push_[x(i)] * push_[x(i)] + push_[y(i)] * push_[y(i)]);
+    return sum;
+  }
+
+  CoordT norm (CoordT x1, CoordT y1)
+  {
+    return std::sqrt(x1 * x1 + y1 * y1);
+  }
+
+  CoordT dist_moved (int i)
+  {
+    return norm(push_[x(i)], push_[y(i)]);
+  }
+
+  CoordT dist_since_triangulation (int i, Triangulation<CoordT> &tri)
+  {
+    return norm(points_[x(i)] - tri.tripoints_[x(i)], points_[y(i)] - tri.tripoints_[y(i)]);
+  }
+}; // end struct Points
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Snapshots
+
+// lock-free triple buffer for one writer and one reader thread: the writer fills its back buffer and publishes it by swapping it with the middle one,
+// the reader swaps its front buffer with the middle one if that was published since; both do one atomic exchange and never wait
+template<typename T>
+class TripleBuffer
+{
+  enum { INDEX = 3, FRESH = 4 };
+
+  T		   buffers_[3];
+  std::atomic<int> middle_{2};	// index of middle buffer, with FRESH bit when published and not yet acquired
+  int		   back_  = 0;	// owned by writer
+  int		   front_ = 1;	// owned by reader
+
+public:
+  T &back () { return buffers_[back_]; }
+  void publish () { back_ = middle_.exchange(back_ | FRESH) & INDEX; }
+
+  // latest published buffer, stays valid until the next call
+  T &acquire ()
+  {
+    if (middle_.load() & FRESH)
+      front_ = middle_.exchange(front_) & INDEX;
+    return buffers_[front_];
+  }
+}; // end class TripleBuffer
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Integrators
+
+// integrator policies for Polyspring turn the accumulated spring push (dt * force) of points into their displacement, in place:
+// prepare() is called once per iteration, then step() on blocks of points from all threads; reorder() follows a renumbering of the points,
+// hash() chains the parameters into layout cache keys
+template<typename CoordT>
+struct EulerIntegrator
+{ // explicit euler as in python: displacement = dt * force
+  void init (int /*numpoints*/) { }
+  uint64_t hash (uint64_t h) const { return h; }
+  void reorder (const std::vector<int> &/*perm*/, std::vector<CoordT> &/*scratch*/) { }
+  void prepare (ThreadPool &/*pool*/, int /*numpoints*/, const CoordT */*push*/) { }
+  void step (int /*begin*/, int /*end*/, CoordT */*push*/) { }
+};
+
+template<typename CoordT>
+struct MomentumIntegrator
+{ // heavy ball: velocity = beta * velocity + dt * force, displacement = velocity
+  double beta_ = 0.5;	// momentum, 0 is euler
+  std::vector<CoordT> velocity_;	// interleaved x/y, displacement of last iteration
+
+  void init (int numpoints) { velocity_.assign(numpoints * 2, 0); }
+  uint64_t hash (uint64_t h) const { return hash_value(beta_, h); }
+  void reorder (const std::vector<int> &perm, std::vector<CoordT> &scratch) { permute_interleaved(perm, velocity_, scratch); }
+  void prepare (ThreadPool &/*pool*/, int /*numpoints*/, const CoordT */*push*/) { }
+  void step (int begin, int end, CoordT *push)
+  {
+    CoordT beta = beta_;
+    for (int i = 2 * begin; i < 2 * end; i++)
+      push[i] = velocity_[i] = beta * velocity_[i] + push[i];
+  }
+};
+
+template<typename CoordT>
+struct FireIntegrator
+{ /* fast inertial relaxation engine (Bitzek et al. 2006), with velocity as displacement per iteration:
+     velocity = (1 - alpha) * velocity + alpha * |velocity| * unit force, then velocity += scale * dt * force;
+     while the total power force . velocity is positive for more than min_steps iterations, scale grows up to max_scale and alpha decays,
+     else scale and alpha are reset and all velocities cleared; a point's velocity is also cleared when its own power is negative,
+     as global power alone lets local oscillations go on forever */
+  double alpha_start_ = 0.1, alpha_decay_ = 0.99;
+  double scale_inc_ = 1.1, max_scale_ = 1.5;	// scale of dt, not below 1 so that convergence by stop_tol still means small forces, above 1.5 it may not converge
+  int    min_steps_ = 5;
+  std::vector<CoordT> velocity_;	// interleaved x/y, displacement of last iteration
+  std::vector<double> partial_;		// per-thread sums of power
+  double alpha_ = 0.1, scale_ = 1;
+  int    positive_ = 0;
+  bool   reset_ = false;
+
+  void init (int numpoints)
+  {
+    velocity_.assign(numpoints * 2, 0);
+    alpha_ = alpha_start_;
+    scale_ = 1;
+    positive_ = 0;
+  }
+
+  void reorder (const std::vector<int> &perm, std::vector<CoordT> &scratch) { permute_interleaved(perm, velocity_, scratch); }
+
+  uint64_t hash (uint64_t h) const
+  {
+    double params[] = { alpha_start_, alpha_decay_, scale_inc_, max_scale_, (double) min_steps_ };
+    return hash_value(params, h);
+  }
+
+  void prepare (ThreadPool &pool, int numpoints, const CoordT *push)
+  {
+    partial_.assign(pool.get_num_threads(), 0);
+    pool.parallel_for(numpoints * 2, [&](int begin, int end, int thread)
+    {
+      double power = 0;
+      for (int i = begin; i < end; i++)
+	power += push[i] * velocity_[i];
+      partial_[thread] = power;
+    });
+
+    double power = std::accumulate(partial_.begin(), partial_.end(), 0.); // in thread order
+    reset_ = power <= 0;
+    if (reset_)
+    {
+      positive_ = 0;
+      scale_ = 1;
+      alpha_ = alpha_start_;
+    }
+    else if (++positive_ > min_steps_)
+    {
+      scale_ = std::min(scale_ * scale_inc_, max_scale_);
+      alpha_ *= alpha_decay_;
+    }
+  } // end FireIntegrator::prepare ()
+
+  void step (int begin, int end, CoordT *push)
+  {
+    CoordT alpha = alpha_, scale = scale_;
+    for (int i = begin; i < end; i++)
+    {
+      CoordT &vx = velocity_[x(i)], &vy = velocity_[y(i)];
+      CoordT &fx = push[x(i)], &fy = push[y(i)];
+      CoordT power = vx * fx + vy * fy;
+      CoordT keep = 0, mix = 0;
+      if (power > 0  &&  !reset_)
+      {
+	keep = 1 - alpha;
+	mix  = alpha * std::sqrt((vx * vx + vy * vy) / (fx * fx + fy * fy));
+      }
+      fx = vx = keep * vx + (mix + scale) * fx;
+      fy = vy = keep * vy + (mix + scale) * fy;
+    }
+  }
+}; // end struct FireIntegrator
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RegionT, DensityT and IntegratorT select region, density and integrator at compile time:
+// the defaults keep region and density swappable at run time (virtual Region, density map pointer),
+// while e.g. Polyspring<float, SquareRegion<float>, UniformDensity<float>> inlines and vectorises the region check and drops the density lookups;
+// MomentumIntegrator or FireIntegrator converge in about half the iterations of the default euler steps (parameters in integrator_)
+template<typename CoordT, typename RegionT = Region<CoordT>, typename DensityT = MapDensity<CoordT>, typename IntegratorT = EulerIntegrator<CoordT>>
+class Polyspring
+{
+  static constexpr bool dynamic_region_ = std::is_same<RegionT, Region<CoordT>>::value;
+  static constexpr bool polygon_region_ = dynamic_region_  ||  std::is_same<RegionT, PolygonRegion<CoordT>>::value; // set_region() accepts polygons
+
+
+public:
+  // simulation parameters
+  double dt_	   = 0.2;   // simulation step
+  double tri_tol_  = 0.1;   // displacement threshold (relative to l0_uni) for retriangularisation
+  double int_pres_ = 1.2;   // spring pressure
+  double k_	   = 1;     // spring stiffness (supposing mass = 1)
+  double stop_tol_ = 0.001;
+  size_t chunk_size_ = 4096; // points, half-edges or edges per resumable chunk of reordering, triangulation, edge rebuild and spring step in iterate_until()
+  int	 local_iter_ = 1000; // max iterations of local relaxation around points added or removed, it stops when they move less than stop_tol
+  double rescale_tol_ = 0.1; // relative change in point count by add_points() or remove_points() above which the rest length follows
+      
+  RegionT		*region_ = NULL;
+  std::unique_ptr<Region<CoordT>> own_region_;	// region created by constructor or set_region()
+  DensityMap<CoordT>	density_;	// own density map for set_density()
+  Attractors<CoordT>	attractors_;
+  IntegratorT		integrator_;
+
+  Points<CoordT>	points_;	// points container
+  Triangulation<CoordT> triangulation_;	// wrapper around delaunay triangulation
+  Edges<CoordT, DensityT> edges_;	// keeps list of edges
+  double		l0_uni_;	// spring rest length
+  double		hscale_ = 0;		// rest length of the current step, l0_uni scaled for the density
+  double		hscale_factor_ = 1;	// rest length scaling factor of last iteration (hscale / l0_uni)
+  std::mt19937		random_;	// own generator for the jitter of 1D views, std::rand() isn't safe in concurrent solvers
+  int			count_ = 0;
+  bool			update_tri_ = false;
+  bool			full_tri_ = true;	// next triangulation update must be full (points changed)
+  bool			incremental_tri_ = false; // repair triangulation by edge flips instead of full triangulation
+
+  // resumable iteration: phases of iterate(), the chunked ones can be interrupted by the deadline of iterate_until();
+  // repair updates the triangulation incrementally if due and possible, else starts a full triangulation, which is reorder (curve indices
+  // in chunks, then one radix digit or one pass over the points per call), seed, sort (one radix digit per call), insert, edges,
+  // edges sort and edges update (chunks); then the spring step: scaling (rest length, non-uniform density), forces, push (sum of the
+  // per-thread push vectors), points (integrate, move, constrain), moved (edge update) and check (retriangulation check), in chunks
+  // of each thread's static part of the edges or points, so that the layout doesn't depend on the chunk size
+  enum Phase { PHASE_REPAIR, PHASE_REORDER, PHASE_SEED, PHASE_SORT, PHASE_INSERT, PHASE_EDGES, PHASE_EDGES_SORT, PHASE_EDGES_UPDATE,
+	       PHASE_SCALING, PHASE_FORCES, PHASE_PUSH, PHASE_POINTS, PHASE_MOVED, PHASE_CHECK, NUM_PHASES };
+  static const char *phase_name (int phase)
+  {
+    static const char *names[NUM_PHASES] = { "repair", "reorder", "seed", "sort", "insert", "edges", "edges_sort", "edges_update",
+					     "scaling", "forces", "push", "points", "moved", "check" };
+    return names[phase];
+  }
+  Phase			phase_ = PHASE_REPAIR;
+  size_t		phase_pos_ = 0;		// progress of chunked phase
+  double		phase_time_[NUM_PHASES] = { 0 };	// moving average of duration of one call of iterate_phase() per phase, in seconds
+  double		max_move_ = 0;		// max displacement in last iteration, relative to l0_uni
+  bool			moved_ = false;		// a point moved more than stop_tol in the current step
+  bool			converged_ = false;	// last iteration moved no point more than stop_tol
+  std::atomic<bool>	stop_{false};		// set by stop_distribute() from any thread
+
+public:
+  // layout published for reader threads
+  struct Snapshot
+  {
+    int    count = 0;	// iteration
+    double max_move = 0;
+    bool   converged = false;
+    std::vector<CoordT> points;	// interleaved x/y scaled back to original bounds
+    std::vector<size_t> triangles;	// interleaved triplets of vertex indices (caller's point indices), clockwise, empty before first triangulation
+    int    tri_count = -1;	// triangulation update the triangles were copied from, to copy them only when changed
+  };
+
+  // background solver
+  std::vector<std::unique_ptr<TripleBuffer<Snapshot>>> snapshots_;	// one triple buffer per reader thread
+  std::thread		solver_;
+  std::atomic<bool>	solving_{false};
+
+  // statistics (with POLYSPRING_STATS)
+  IterationStats	stats_;		// being collected for the current iteration
+  IterationStats	last_stats_;	// of the last complete iteration
+  std::vector<IterationStats> stats_history_;	// ring buffer of the last iterations
+  size_t		stats_next_ = 0;	// next slot in stats_history_
+  int			stats_count_ = 0;	// number of valid entries
+  int			stats_flips_ = 0;	// triangulation flip count at end of last iteration
+  struct ThreadStats { int count = 0, outside = 0; double sum = 0, energy = 0; };
+  std::vector<ThreadStats> thread_stats_;
+
+  // multithreading
+  ThreadPool		pool_;
+  std::vector<std::vector<CoordT>> thread_push_;	// per-thread push vectors (thread 0 uses points_.push_), summed in thread order
+  std::vector<double>	thread_sum_;	// per-thread partial sums
+  std::vector<char>	thread_flag_;	// per-thread flags
+  std::vector<CoordT>	thread_max_;	// per-thread maxima
+
+  void init_threads ();
+  void update_edges (int begin = 0, int end = std::numeric_limits<int>::max());
+  void update_points (int begin, int end, int thread);
+  bool iterate_phase (size_t chunk, bool &keep_going);
+  bool finish_iteration (bool &keep_going);
+  void finish_step ();
+  void finish_stats ();
+  void points_changed (bool local_ok, std::vector<int> &seeds);
+  bool relax_local (std::vector<int> &seeds);
+
+  // multilevel solver: levels are nested random subsets of the points (prefixes of ml_order_) of growing size,
+  // the coarsest is solved to convergence, each finer one is started by barycentric interpolation of the solved coarser one
+  // through the triangulation of their pre-uniformised positions, and refined for ml_refine_iter_ iterations
+  int			ml_min_points_ = 0;	// minimum size of the coarsest level, 0 for single level
+  double		ml_ratio_ = 4;		// size ratio between levels
+  int			ml_refine_iter_ = 10;	// iterations per level above the coarsest
+  int			ml_level_ = -1;		// index into ml_sizes_ of level being solved in points_, -1 when all points are
+  int			ml_iter_ = 0;		// iterations on current level
+  std::vector<int>	ml_sizes_;		// number of points per level, ascending
+  std::vector<int>	ml_order_;		// random permutation of point indices
+  std::vector<CoordT>	ml_init_;		// pre-uniformised positions of all points
+  Points<CoordT>	ml_full_;		// all points while a coarse level is solved in points_
+  DelaunayTriangulator<CoordT> ml_del_;	// triangulation of a level's pre-uniformised positions
+  std::vector<CoordT>	ml_ref_;
+  std::vector<size_t>	ml_grid_;		// start half-edge of point location per grid cell
+
+  void multilevel_start ();
+  void multilevel_next ();	// interpolate to next level
+  void multilevel_finish () { while (ml_level_ >= 0) multilevel_next(); }
+  Points<CoordT> &all_points () { return ml_level_ >= 0  ?  ml_full_  :  points_; }
+
+  // spatial order: from reorder_min_points_ points on, points are renumbered along a hilbert curve at the first full triangulation
+  // and again every reorder_interval_ full triangulations as the layout evolves, and edges are sorted by end point
+  int			reorder_min_points_ = 1 << 15;	// about where the point arrays outgrow L2 cache, 0 to keep caller's order
+  int			reorder_interval_ = 16;
+  int			reorder_count_ = 0;	// full triangulations since last reordering
+  std::vector<CoordT>	reorder_scratch_;
+
+  // scratch for incremental updates
+  std::vector<char>	mark_;
+  std::vector<int>	local_edges_;
+  std::vector<int>	local_points_;	// points moved by relax_local()
+  std::vector<CoordT>	local_start_;	// their interleaved positions at the last legalisation
+  std::vector<char>	dead_;
+
+public:
+  Polyspring ()	// set default region 0..1 square (or empty RegionT), signed distance function, inner box
+  : own_region_(new typename std::conditional<dynamic_region_, SquareRegion<CoordT>, RegionT>::type)
+  {
+    region_ = static_cast<RegionT *>(own_region_.get());
+    set_snapshot_readers(1);
+  }
+
+  ~Polyspring () { stop_solver(); }
+
+  // set region the points are distributed in, in normalised coordinates, updates spring rest length
+  // (call set_points() again to redo the pre-uniformisation into the new region's inner box)
+  void set_region (std::string name);	// "square", or list of x y coordinates of a polygon
+  void set_region (int numrings, const int ringsizes[], const CoordT *coords);	// polygon, first ring outside, others holes (dynamic or polygon RegionT)
+  void set_region (RegionT *region);	// use caller's region (not copied, must stay valid)
+  RegionT &get_region () { return *region_; }
+  void set_points (int numtotal, int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int colx, int coly);   // copy points from buffers into vector, do rescaling and pre-uniformisation
+  // incremental corpus updates: new points are appended (placed next to the point nearest in original coordinates), removed points are deleted
+  // keeping the order of the others; the triangulation is updated locally, and the neighbourhood relaxed until it moves less than stop_tol_
+  // (at most local_iter_ iterations; call with the solver thread stopped); a converged layout stays converged if that succeeds and the
+  // point count is within rescale_tol_ of the one the rest length was computed for, else the rest length follows the number of points
+  // and all points move until the layout reconverges (on 20k uniform points, adding 100 takes 100 to 250 local iterations of some 600 points,
+  // 40 to 80 ms, and the layout stays converged, where relaxing all points took about 1900 iterations)
+  void add_points (int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int colx, int coly);
+  void remove_points (int num, const int indices[]);
+
+  // multilevel coarse-to-fine solver for large corpora, used by set_points() if there are at least ratio * minpoints points:
+  // solve a random subset of about minpoints first, then interpolate to ratio times more points and refine for refine_iter iterations per level,
+  // until all points are solved; until then, get_points() and snapshots return the layout interpolated at the last level change (without triangles)
+  void set_multilevel (int minpoints, double ratio = 4, int refine_iter = 10)
+  {
+    ml_min_points_  = minpoints;
+    ml_ratio_       = std::max(ratio, 1.5);
+    ml_refine_iter_ = refine_iter;
+  }
+
+  // renumber points internally for memory locality from minpoints points on (0 never), refreshed every interval full triangulations;
+  // transparent to the caller: point indices of all methods and snapshots stay in the order of set_points() and add_points()
+  void set_spatial_order (int minpoints, int interval = 16)
+  {
+    reorder_min_points_ = minpoints;
+    reorder_interval_   = std::max(interval, 1);
+  }
+
+  // write layout scaled to original bounds into output columns of buffers (same layout as for set_points), interp 0..1 mixes in the original positions
+  void get_points (int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int outcolx, int outcoly, CoordT interp = 0)
+  {
+    all_points().get(numbuffers, bufsizes, buffers, bufwidth, outcolx, outcoly, interp, pool_);
+  }
+
+  // for layout caches (see polyspring-io.hpp):
+  int  get_num_points () { return all_points().numpoints_; }
+  void get_original (CoordT *out) { all_points().get_original(out); }	// interleaved original coords of set_points(), caller's order
+  void get_normalised (CoordT *out) { all_points().get_normalised(out); }	// interleaved normalised layout, caller's order
+  void get_bounds (std::vector<CoordT> &bounds_min, std::vector<CoordT> &bounds_range) { all_points().get_bounds(bounds_min, bounds_range); }
+  // hash of everything but the points that determines the layout: region, density map, solver and integrator parameters, integrator and coordinate type
+  uint64_t get_setup_hash ();
+  // after set_points(), start from normalised positions layout (interleaved, caller's order) instead of the pre-uniformisation,
+  // points with known[i] == 0 are placed next to their nearest known point in original coordinates, iterate() goes on from there
+  void set_layout (const CoordT *layout, const char *known = NULL);
+  // after set_points(), restore a converged layout and its triangulation (numhalf half-edges' start vertices as caller's point indices,
+  // and opposite half-edges, -1 on the hull) without iterating, count is the iteration count to report
+  void set_converged_layout (const CoordT *layout, size_t numhalf, const int *triangles, const int *halfedges, int count);
+
+  // copy triangles as interleaved triplets of point indices, clockwise, returns false (and no triangles) while the triangulation is being updated
+  bool get_vertices (std::vector<size_t> &vertices)
+  {
+    vertices.clear();
+    if (!triangulation_.valid()  ||  full_tri_  ||  ml_level_ >= 0)
+      return false;
+    vertices.assign(triangulation_.get_vertices().begin(), triangulation_.get_vertices().end());
+    points_.caller_indices(vertices);
+    return true;
+  }
+  // copy opposite half-edges of the triangles of get_vertices(), INVALID_INDEX on the hull
+  bool get_halfedges (std::vector<size_t> &halfedges)
+  {
+    halfedges.clear();
+    if (!triangulation_.valid()  ||  full_tri_  ||  ml_level_ >= 0)
+      return false;
+    halfedges = triangulation_.get_halfedges();
+    return true;
+  }
+
+  // target density h_dist on the normalised 0..1 square, default uniform
+  void set_density (int width, int height, const float *density, int colstride = 1, int rowstride = 0);  // copy from density grid buffer, e.g. jitter matrix
+  template<typename F>
+  void set_density_function (int width, int height, F &&hfunc) { density_.set_function(width, height, hfunc);  set_density(&density_); }
+  void set_density (const DensityMap<CoordT> *map);	// use caller's precomputed map (not copied, must stay valid), NULL for uniform
+  void clear_density () { set_density(NULL); }
+
+  // gaussian attractors displacing the uniformised layout (stored by store_uniform() or at convergence of iterate())
+  void set_attractors (int num, const CoordT *params);	// num gaussians given as interleaved mx, my, sigx, sigy, theta; 0 resets to the uniformised layout
+  void store_uniform () { points_.uni_points_ = points_.points_; }
+  bool iterate ();	// one iteration, returns false when converged
+
+  // time-budgeted iteration for real-time hosts: run iterations (or resumable chunks of them) as long as they are expected to end before the deadline,
+  // at least one phase chunk per call, until converged or cancelled by stop_distribute();
+  // the spring step is chunked like the triangulation (chunk_size_), what a budget can't split are the single passes over all points
+  // of a full triangulation (seed, one radix digit of the sort or the reordering: a few ms for 300k points on one thread)
+  struct Progress
+  {
+    int    count;	// number of iterations done
+    double max_move;	// max displacement of a point inside the region in the last iteration, relative to spring rest length (stops below stop_tol_)
+    bool   converged;	// converged, further calls do nothing until set_points(), set_region(), or set_density()
+    bool   cancelled;	// returned early because of stop_distribute()
+  };
+  Progress iterate_until (std::chrono::steady_clock::time_point deadline);
+  Progress iterate_for (long budget_us) { return iterate_until(std::chrono::steady_clock::now() + std::chrono::microseconds(budget_us)); }
+  Progress get_progress () { return { count_, max_move_, converged_, false }; }
+  void stop_distribute () { stop_ = true; }	// thread-safe, makes the running or next iterate_until() or background solver return
+
+  // background solver: iterate in a thread until converged or stopped, publishing every every-th and the last iteration,
+  // no other method but get_snapshot() and stop_distribute() may be called until stop_solver()
+  void start_solver (int every = 1);
+  void stop_solver ();	// stop and join solver thread
+  bool solver_running () { return solving_; }
+
+  // layout snapshots for other threads, each reader thread reads wait-free from its own triple buffer
+  void set_snapshot_readers (int num);	// number of reader threads, default 1, not while solver is running
+  void publish ();	// publish current layout to all readers (called by background solver, or by the iterating thread)
+  const Snapshot &get_snapshot (int reader = 0) { return snapshots_[reader]->acquire(); }	// latest published layout, valid until next call by same reader
+  void set_incremental_triangulation (bool incr) { incremental_tri_ = incr; };
+  void set_num_threads (int num);	// set number of threads used by iterate(), 0 = hardware concurrency
+  int get_num_threads () { return pool_.get_num_threads(); };
+  int get_count() { return count_; };
+  static long get_allocation_count ();	// number of heap allocations so far, -1 if not compiled with POLYSPRING_COUNT_ALLOCATIONS
+
+  // statistics of the last complete iteration, all zero if not compiled with POLYSPRING_STATS, not while the solver thread runs
+  const IterationStats &get_stats () { return last_stats_; }
+  void set_stats_history (int size)	// keep stats of the last size iterations, 0 for none
+  {
+    stats_history_.assign(size, IterationStats());
+    stats_next_ = stats_count_ = 0;
+  }
+  int get_stats_history (std::vector<IterationStats> &history)	// copy kept stats, oldest first, returns their number
+  {
+    history.clear();
+    for (int i = 0; i < stats_count_; i++)
+      history.push_back(stats_history_[(stats_next_ + stats_history_.size() - stats_count_ + i) % stats_history_.size()]);
+    return stats_count_;
+  }
+  int get_triangulation_count() { return triangulation_.tri_count_; };
+}; // end class Polyspring
+
+#define POLYSPRING_TEMPLATE template<typename CoordT, typename RegionT, typename DensityT, typename IntegratorT>
+#define POLYSPRING_CLASS    Polyspring<CoordT, RegionT, DensityT, IntegratorT>
+
+
+// copy points from buffers into vector, do rescaling
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_points (int numtotal, int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int colx, int coly)
+{
+  finish_step();
+  ml_level_ = -1;
+  points_.set(numtotal, numbuffers, bufsizes, buffers, bufwidth, colx, coly);
+#if DEBUG_POLY
+  vector_print("bounds min", points_.bounds_min_);
+  vector_print("     range", points_.bounds_range_);
+#endif
+  
+  // pre-uniformization, replaces points by normalised sort index
+  // and scale points to fit into region's inner box
+  CoordT ydim = points_.pre_uniformize(*region_, pool_);
+    
+  if (colx == coly)
+  { // all points are in a line: make triangulation possible by random y displacement
+    const CoordT epsilon = ydim / points_.numpoints_ * 1e-2;	// max random displacement: 1/1000 of inter-point distance
+
+    random_.seed(1);	// fixed seed for reproducible layouts
+    for (int i = 0; i < points_.numpoints_; i++)
+      points_.points_[i * 2 + 1] += (CoordT) random_() / random_.max() * epsilon;
+  }
+
+#if DEBUG_POLY > 2
+  vector_print("pre-uni", points_.points_);
+#endif
+
+  // compute the spring rest length
+  // self.l0_uni = np.sqrt(2 / (np.sqrt(3) * len(self.points) / self.region.area))
+  double area = region_->get_area();
+  l0_uni_ = sqrt(2 / (sqrt(3) * numtotal / area));
+  
+  count_ = 0;
+  update_tri_ = true;
+  full_tri_ = true;
+  phase_ = PHASE_REPAIR;
+  max_move_ = 0;
+  converged_ = false;
+  stop_ = false;
+  points_.uni_points_.clear();
+  integrator_.init(numtotal);
+  init_threads();
+
+  if (ml_min_points_ > 0  &&  numtotal >= ml_ratio_ * ml_min_points_)
+    multilevel_start();
+} // end Polyspring::set_points ()
+
+// split pre-uniformised points into levels and start solving the coarsest
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::multilevel_start ()
+{
+  int num = points_.numpoints_;
+
+  ml_sizes_.clear();
+  for (double size = num; size >= ml_min_points_; size /= ml_ratio_)
+    ml_sizes_.push_back((int) size);
+  std::reverse(ml_sizes_.begin(), ml_sizes_.end());
+
+  // fixed seed for reproducible layouts, Fisher-Yates with plain modulo (bias negligible) to be independent of the standard library
+  std::mt19937 random(1);
+  ml_order_.resize(num);
+  std::iota(ml_order_.begin(), ml_order_.end(), 0);
+  for (int i = num - 1; i > 0; i--)
+    std::swap(ml_order_[i], ml_order_[random() % (i + 1)]);
+
+  ml_init_ = points_.points_;
+  ml_full_ = std::move(points_);
+  points_.set_subset(ml_full_, ml_order_.data(), ml_sizes_[0]);
+  ml_level_ = 0;
+  ml_iter_  = 0;
+  // global change: every point moves a little until the layout reconverges
+  l0_uni_ = sqrt(2 / (sqrt(3) * points_.numpoints_ / region_->get_area()));
+  integrator_.init(points_.numpoints_);
+  init_threads();
+} // end Polyspring::multilevel_start ()
+
+// write back the solved level, and interpolate the points of the next level barycentrically in the triangulation of the level's pre-uniformised positions
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::multilevel_next ()
+{
+  std::vector<CoordT> &full = ml_full_.points_;
+  std::vector<CoordT> &pts  = points_.points_;
+  int num = points_.numpoints_, next = ml_sizes_[ml_level_ + 1];
+
+  for (int i = 0; i < num; i++)
+  {
+    full[x(ml_order_[i])] = pts[x(i)];
+    full[y(ml_order_[i])] = pts[y(i)];
+  }
+
+  ml_ref_.resize(num * 2);
+  for (int i = 0; i < num; i++)
+  {
+    ml_ref_[x(i)] = ml_init_[x(ml_order_[i])];
+    ml_ref_[y(i)] = ml_init_[y(ml_order_[i])];
+  }
+  ml_del_.triangulate(ml_ref_.data(), num);
+
+  std::vector<size_t> &tri  = ml_del_.triangles_;
+  std::vector<size_t> &half = ml_del_.halfedges_;
+  const CoordT *ref = ml_ref_.data();
+
+  // start of point location walk: a triangle with its centroid in the grid cell, about 2 per cell (pre-uniformised points are in 0..1)
+  int  g = std::max(1, (int) std::sqrt(tri.size() / 6.));
+  auto cell = [&](double px, double py) { return std::min(std::max((int) (py * g), 0), g - 1) * g + std::min(std::max((int) (px * g), 0), g - 1); };
+  ml_grid_.assign(g * g, 0);
+  for (size_t t = 0; t < tri.size(); t += 3)
+    ml_grid_[cell((ref[x(tri[t])] + ref[x(tri[t + 1])] + ref[x(tri[t + 2])]) / 3, (ref[y(tri[t])] + ref[y(tri[t + 1])] + ref[y(tri[t + 2])]) / 3)] = t;
+
+  pool_.parallel_for(next - num, [&](int begin, int end, int /*thread*/)
+  {
+    for (int i = num + begin; i < num + end; i++)
+    {
+      int    p  = ml_order_[i];
+      double px = ml_init_[x(p)], py = ml_init_[y(p)];
+      size_t t  = ml_grid_[cell(px, py)];
+
+      // walk towards p over edges p is on the outer side of (triangles are clockwise), until inside or at the hull
+      for (int step = 0, moved = 1; moved  &&  step < 4 * g + 16; step++)
+      {
+	moved = 0;
+	for (size_t e = t; e < t + 3; e++)
+	{
+	  size_t a = tri[e], b = tri[next_halfedge(e)];
+	  if (half[e] != INVALID_INDEX  &&  orient2d(ref[x(a)], ref[y(a)], ref[x(b)], ref[y(b)], px, py) > 0)
+	  {
+	    t = half[e] - half[e] % 3;
+	    moved = 1;
+	    break;
+	  }
+	}
+      }
+
+      // barycentric weights from clockwise sub-triangle areas, clamped for points outside the hull
+      size_t a = tri[t], b = tri[t + 1], c = tri[t + 2];
+      double wa = std::max(0., -orient2d(px, py, ref[x(b)], ref[y(b)], ref[x(c)], ref[y(c)]));
+      double wb = std::max(0., -orient2d(ref[x(a)], ref[y(a)], px, py, ref[x(c)], ref[y(c)]));
+      double wc = std::max(0., -orient2d(ref[x(a)], ref[y(a)], ref[x(b)], ref[y(b)], px, py));
+      double sum = wa + wb + wc;
+      if (sum <= 0)
+	wa = sum = 1, wb = wc = 0;
+
+      full[x(p)] = (wa * pts[x(a)] + wb * pts[x(b)] + wc * pts[x(c)]) / sum;
+      full[y(p)] = (wa * pts[y(a)] + wb * pts[y(b)] + wc * pts[y(c)]) / sum;
+      if (!region_->point_is_within(full[x(p)], full[y(p)]))
+	region_->move_point_back(full[x(p)], full[y(p)]);
+    }
+  });
+
+  ml_level_++;
+  ml_iter_ = 0;
+  if (ml_level_ + 1 == (int) ml_sizes_.size())
+  { // finest level: all points, in caller's order
+    points_   = std::move(ml_full_);
+    ml_level_ = -1;
+    std::fill(points_.push_.begin(), points_.push_.end(), 0);
+  }
+  else
+    points_.set_subset(ml_full_, ml_order_.data(), next);
+
+  // global change: every point moves a little until the layout reconverges
+  l0_uni_ = sqrt(2 / (sqrt(3) * points_.numpoints_ / region_->get_area()));
+  integrator_.init(points_.numpoints_);
+  init_threads();
+  update_tri_ = full_tri_ = true;
+  phase_ = PHASE_REPAIR;
+  converged_ = false;
+} // end Polyspring::multilevel_next ()
+
+
+POLYSPRING_TEMPLATE
+uint64_t POLYSPRING_CLASS::get_setup_hash ()
+{
+  double      params[] = { dt_, tri_tol_, int_pres_, k_, stop_tol_, (double) sizeof(CoordT) };
+  const char *integrator = typeid(IntegratorT).name();
+  uint64_t    h = hash_bytes(params, sizeof(params));
+
+  h = hash_bytes(integrator, strlen(integrator), h);
+  h = integrator_.hash(h);
+  h = region_->hash(h);
+  if constexpr (!DensityT::uniform)
+    if (edges_.density_.map_)
+      h = edges_.density_.map_->hash(h);
+  return h;
+} // end Polyspring::get_setup_hash ()
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_layout (const CoordT *layout, const char *known)
+{
+  finish_step();
+  if (ml_level_ >= 0)
+  { // no coarse levels needed
+    points_   = std::move(ml_full_);
+    ml_level_ = -1;
+    l0_uni_   = sqrt(2 / (sqrt(3) * points_.numpoints_ / region_->get_area()));
+    init_threads();
+  }
+
+  std::vector<CoordT> &pts = points_.points_;
+  std::vector<int> given, missing;
+  for (int i = 0; i < points_.numpoints_; i++)
+  {
+    int c = points_.caller_index(i);
+    if (known  &&  !known[c])
+      missing.push_back(i);
+    else
+    {
+      pts[x(i)] = layout[x(c)];
+      pts[y(i)] = layout[y(c)];
+      given.push_back(i);
+    }
+  }
+
+  if (!missing.empty()  &&  !given.empty())
+  { // around the nearest known point, in golden angle steps so that points placed at the same one don't coincide
+    std::vector<int> nearest(missing.size());
+    points_.nearest_original(missing.size(), [&](int k) { return missing[k]; }, given.size(), [&](int k) { return given[k]; }, nearest.data());
+    for (size_t k = 0; k < missing.size(); k++)
+    {
+      int p = missing[k];
+      pts[x(p)] = pts[x(nearest[k])] + 0.1 * l0_uni_ * std::cos(2.39996 * k);
+      pts[y(p)] = pts[y(nearest[k])] + 0.1 * l0_uni_ * std::sin(2.39996 * k);
+      if (!region_->point_is_within(pts[x(p)], pts[y(p)]))
+	region_->move_point_back(pts[x(p)], pts[y(p)]);
+    }
+  }
+
+  std::fill(points_.push_.begin(), points_.push_.end(), 0);
+  points_.uni_points_.clear();
+  integrator_.init(points_.numpoints_);
+  update_tri_ = full_tri_ = true;
+  phase_ = PHASE_REPAIR;
+  max_move_ = 0;
+  converged_ = false;
+} // end Polyspring::set_layout ()
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_converged_layout (const CoordT *layout, size_t numhalf, const int *triangles, const int *halfedges, int count)
+{
+  set_layout(layout);
+
+  if (points_.reordered())
+  { // to internal point indices
+    std::vector<int> vertices(triangles, triangles + numhalf);
+    for (int &v : vertices)
+      v = points_.point_index(v);
+    triangulation_.set(points_.points_, numhalf, vertices.data(), halfedges);
+  }
+  else
+    triangulation_.set(points_.points_, numhalf, triangles, halfedges);
+  edges_.set(triangulation_.get_vertices(), triangulation_.get_halfedges());
+  if (points_.reordered())
+    while (!edges_.sort(points_.numpoints_))
+      ;
+  update_edges();
+
+  update_tri_ = full_tri_ = false;
+  converged_ = true;
+  count_ = count;
+  store_uniform();
+} // end Polyspring::set_converged_layout ()
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_region (RegionT *region)
+{
+  region_ = region;
+  converged_ = false;
+
+  // compute the spring rest length
+  if (points_.numpoints_ > 0)
+    l0_uni_ = sqrt(2 / (sqrt(3) * points_.numpoints_ / region_->get_area()));
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_region (int numrings, const int ringsizes[], const CoordT *coords)
+{
+  if constexpr (dynamic_region_)
+    own_region_.reset(new PolygonRegion<CoordT>(numrings, ringsizes, coords));
+  else
+  {
+    static_assert(polygon_region_, "polygon needs dynamic or polygon region type");
+    static_cast<RegionT *>(own_region_.get())->set(numrings, ringsizes, coords);
+  }
+  set_region(static_cast<RegionT *>(own_region_.get()));
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_region (std::string name)
+{
+  if (name == "square")
+  {
+    if constexpr (dynamic_region_)
+    {
+      own_region_.reset(new SquareRegion<CoordT>);
+      set_region(own_region_.get());
+    }
+    else if constexpr (polygon_region_)
+    { // unit square as polygon
+      const CoordT square[8] = { 0, 0,  1, 0,  1, 1,  0, 1 };
+      int numvertices = 4;
+      set_region(1, &numvertices, square);
+    }
+  }
+  else if constexpr (polygon_region_)
+  { // parse polygon coordinates
+    std::istringstream stream(name);
+    std::vector<CoordT> coords{std::istream_iterator<CoordT>(stream), std::istream_iterator<CoordT>()};
+    int numvertices = coords.size() / 2;
+
+    if (numvertices >= 3)
+      set_region(1, &numvertices, coords.data());
+  }
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_density (int width, int height, const float *density, int colstride, int rowstride)
+{
+  density_.set(width, height, density, colstride, rowstride);
+  set_density(&density_);
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_density (const DensityMap<CoordT> *map)
+{
+  static_assert(!DensityT::uniform, "density needs a density map policy");
+  edges_.density_.map_ = map;
+  converged_ = false;
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_attractors (int num, const CoordT *params)
+{
+  if (points_.uni_points_.size() != points_.points_.size())
+    store_uniform();
+
+  if (num <= 0)
+  { // reset
+    points_.points_ = points_.uni_points_;
+    return;
+  }
+
+  attractors_.set(num, params);
+  attractors_.rasterize(points_.numpoints_, l0_uni_, pool_);
+  attractors_.apply(points_.numpoints_, points_.uni_points_.data(), points_.points_.data(), pool_);
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_num_threads (int num)
+{
+  finish_step();	// the step's parts are per thread
+  pool_.set_num_threads(num);
+  init_threads();
+}
+
+// allocate per-thread scratch buffers
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::init_threads ()
+{
+  int numthreads = pool_.get_num_threads();
+
+  thread_push_.resize(numthreads);
+  for (int t = 1; t < numthreads; t++)
+    thread_push_[t].assign(points_.numpoints_ * 2, 0);
+  thread_sum_.resize(numthreads);
+  thread_flag_.resize(numthreads);
+  thread_max_.resize(numthreads);
+  thread_stats_.resize(numthreads);
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::add_points (int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int colx, int coly)
+{
+  finish_step();
+  multilevel_finish();
+  int numold = points_.numpoints_;
+  // local insertion needs a complete triangulation of the current points
+  bool local_ok = numold >= 3  &&  !full_tri_  &&  phase_ == PHASE_REPAIR  &&  triangulation_.valid();
+  std::vector<int> seeds;
+
+  points_.append(numbuffers, bufsizes, buffers, bufwidth, colx, coly);
+  if (numold == 0)
+  {
+    set_points(points_.numpoints_, numbuffers, bufsizes, buffers, bufwidth, colx, coly);
+    return;
+  }
+
+  std::vector<int> nearest(points_.numpoints_ - numold);
+  points_.nearest_original(numold, nearest.size(), numold, nearest.data());
+
+  for (int p = numold; p < points_.numpoints_; p++)
+  { // place inside a triangle of the nearest point: 0.6 nearest + 0.2 each other vertex, else next to it
+    std::vector<CoordT> &pts = points_.points_;
+    size_t e = local_ok  ?  triangulation_.vertex_halfedge_[nearest[p - numold]]  :  INVALID_INDEX;
+
+    if (e != INVALID_INDEX)
+    {
+      std::vector<size_t> &tri = triangulation_.get_vertices();
+      pts[x(p)] = 0.6 * pts[x(tri[e])] + 0.2 * (pts[x(tri[next_halfedge(e)])] + pts[x(tri[prev_halfedge(e)])]);
+      pts[y(p)] = 0.6 * pts[y(tri[e])] + 0.2 * (pts[y(tri[next_halfedge(e)])] + pts[y(tri[prev_halfedge(e)])]);
+      local_ok = triangulation_.add_point(pts, p, e,
+					  [&](size_t e0, size_t f0, size_t g0) { edges_.split(triangulation_.get_vertices(), e0, f0, g0); },
+					  [&](size_t a, size_t b, size_t ar, size_t bl, int p0, int p1) { edges_.flip(a, b, ar, bl, p0, p1); });
+    }
+    else
+    {
+      pts[x(p)] = pts[x(nearest[p - numold])] + 0.1 * l0_uni_;
+      pts[y(p)] = pts[y(nearest[p - numold])];
+      local_ok = false;
+    }
+    seeds.push_back(p);
+  }
+
+  if (points_.uni_points_.size() > 0)
+    points_.uni_points_.insert(points_.uni_points_.end(), points_.points_.begin() + x(numold), points_.points_.end());
+  points_changed(local_ok, seeds);
+} // end Polyspring::add_points ()
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::remove_points (int num, const int indices[])
+{
+  finish_step();
+  multilevel_finish();
+  int  numold = points_.numpoints_;
+  bool local_ok = !full_tri_  &&  phase_ == PHASE_REPAIR  &&  triangulation_.valid();
+  std::vector<int> seeds, remap(numold);
+
+  // mark removed points, their remaining neighbours are relaxed
+  mark_.assign(numold, 0);
+  for (int i = 0; i < num; i++)
+    if (indices[i] >= 0  &&  indices[i] < numold)
+      mark_[points_.point_index(indices[i])] = 1;
+  for (int e = 0; e < edges_.numedges_  &&  local_ok; e++)
+    if (mark_[edges_.a_[e]] != mark_[edges_.b_[e]])
+      seeds.push_back(mark_[edges_.a_[e]]  ?  edges_.b_[e]  :  edges_.a_[e]);
+
+  for (int i = 0; i < numold  &&  local_ok; i++)
+    if (mark_[i])
+      local_ok = triangulation_.remove_point(points_.points_, i, dead_);
+
+  int numremain = 0;
+  for (int i = 0; i < numold; i++)
+    remap[i] = mark_[i]  ?  -1  :  numremain++;
+  if (numremain == numold)
+    return;
+
+  points_.remove(remap, numremain);
+  if (local_ok)
+  {
+    triangulation_.compact(dead_, remap, numremain);
+    edges_.set(triangulation_.get_vertices(), triangulation_.get_halfedges());
+    if (points_.reordered())
+      while (!edges_.sort(numremain))
+	;
+  }
+  for (int &p : seeds)
+    p = remap[p];
+  seeds.erase(std::remove(seeds.begin(), seeds.end(), -1), seeds.end());
+  points_changed(local_ok  &&  numremain >= 3, seeds);
+} // end Polyspring::remove_points ()
+
+// after adding or removing points: relax around seed points if the triangulation was updated locally, else retriangulate fully
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::points_changed (bool local_ok, std::vector<int> &seeds)
+{
+  // the rest length is kept for small changes, so that the layout of the other points stays in equilibrium;
+  // l0_uni_ was computed for numl0 points (the count since the last rescale)
+  double area  = region_->get_area();
+  double numl0 = 2 * area / (sqrt(3) * l0_uni_ * l0_uni_);
+  bool	 local = local_ok  &&  std::fabs(points_.numpoints_ / numl0 - 1) <= rescale_tol_;
+  if (!local) // global change: every point moves a little until the layout reconverges
+    l0_uni_ = sqrt(2 / (sqrt(3) * points_.numpoints_ / area));
+  integrator_.init(points_.numpoints_);
+  init_threads();
+
+  if (local_ok)
+  { // edges were patched or rebuilt by the caller
+    update_edges();
+    local &= relax_local(seeds);
+  }
+  else
+  { // full triangulation in next iteration
+    full_tri_ = update_tri_ = true;
+    phase_ = PHASE_REPAIR;
+  }
+  converged_ = converged_  &&  local;
+} // end Polyspring::points_changed ()
+
+// iterate springs of edges touching the seed points and their neighbours, moving only those (and the points of quads flipped on the way),
+// the other points stay fixed, until no point moves more than stop_tol (returns true) or for local_iter_ iterations
+POLYSPRING_TEMPLATE
+bool POLYSPRING_CLASS::relax_local (std::vector<int> &seeds)
+{
+  std::vector<CoordT> &pts  = points_.points_;
+  std::vector<CoordT> &push = points_.push_;
+  std::vector<size_t> &tri  = triangulation_.get_vertices();
+
+  // mark seeds (2) and their neighbours (1)
+  mark_.assign(points_.numpoints_, 0);
+  for (int p : seeds)
+    mark_[p] = 2;
+  for (int e = 0; e < edges_.numedges_; e++)
+  {
+    int a = edges_.a_[e], b = edges_.b_[e];
+    if (mark_[a] == 2  ||  mark_[b] == 2)
+      mark_[a] = std::max<char>(mark_[a], 1), mark_[b] = std::max<char>(mark_[b], 1);
+  }
+  local_points_.clear();
+  local_start_.clear();
+  for (int p = 0; p < points_.numpoints_; p++)
+    if (mark_[p])
+    {
+      local_points_.push_back(p);
+      local_start_.insert(local_start_.end(), { pts[x(p)], pts[y(p)] });
+    }
+
+  // the neighbourhood grows by the points of flipped quads, to make room where the triangulation changes
+  auto add_point = [&] (int p)
+  {
+    if (!mark_[p])
+    {
+      mark_[p] = 1;
+      local_points_.push_back(p);
+      local_start_.insert(local_start_.end(), { pts[x(p)], pts[y(p)] });
+    }
+  };
+
+  // edges touching marked points, collected again after flips, which join marked points to others
+  auto collect_edges = [&] ()
+  {
+    local_edges_.clear();
+    for (int p : local_points_)
+      triangulation_.around(p, [&](size_t h) { local_edges_.push_back(edges_.halfedge_edge_[h]); });
+    std::sort(local_edges_.begin(), local_edges_.end());
+    local_edges_.erase(std::unique(local_edges_.begin(), local_edges_.end()), local_edges_.end());
+  };
+
+  // make the triangulation delaunay again (up to margin) around the marked points that moved more than thresh since their last time,
+  // as repair() does; edges are patched in place, on failure, retriangulate fully
+  auto legalize = [&] (CoordT thresh, double margin)
+  {
+    triangulation_.flip_stack_.clear();
+    for (size_t k = 0; k < local_points_.size(); k++)
+    {
+      int    p	= local_points_[k];
+      CoordT dx = pts[x(p)] - local_start_[x(k)], dy = pts[y(p)] - local_start_[y(k)];
+      if (dx * dx + dy * dy < thresh * thresh)
+	continue;
+      triangulation_.around(p, [&](size_t h) { triangulation_.flip_stack_.push_back(h);
+					       triangulation_.flip_stack_.push_back(next_halfedge(h)); });
+      local_start_[x(k)] = pts[x(p)];
+      local_start_[y(k)] = pts[y(p)];
+    }
+    if (triangulation_.flip_stack_.empty())
+      return true;
+    if (!triangulation_.legalize(pts, [&](size_t a, size_t b, size_t ar, size_t bl, int p0, int p1)
+				 {
+				   edges_.flip(a, b, ar, bl, p0, p1);
+				   for (size_t h = 0; h < 3; h++)
+				     add_point(tri[a / 3 * 3 + h]), add_point(tri[b / 3 * 3 + h]);
+				 }, margin))
+    {
+      full_tri_ = update_tri_ = true;
+      return false;
+    }
+    collect_edges();
+    return true;
+  };
+
+  CoordT rest    = int_pres_ * l0_uni_ * hscale_factor_;
+  CoordT maxstep = tri_tol_ * l0_uni_;	// limit steps of squeezed new points
+  CoordT tol	 = stop_tol_ * l0_uni_;
+  bool	 converged = false, valid = legalize(0, 0);
+
+  // while relaxing, only flip edges far off the delaunay condition, beyond reach of triangles of about spring length, as when points
+  // move into the room left by removed ones: against the fixed points around, a nearly cocircular quad would flip back and forth
+  double margin = std::pow(l0_uni_, 4);
+
+  for (int iter = 0; iter < local_iter_  &&  valid  &&  !converged; iter++)
+  {
+    for (int e : local_edges_)
+    { // same force as compute_forces and scatter_forces
+      int    a = edges_.a_[e], b = edges_.b_[e];
+      CoordT dx = pts[x(b)] - pts[x(a)], dy = pts[y(b)] - pts[y(a)];
+      CoordT len = std::sqrt(dx * dx + dy * dy), fx, fy;
+
+      spring_force_kernel_scalar<CoordT>(0, 1, &dx, &dy, &len, &edges_.rest_dist_[e], rest, k_, dt_, &fx, &fy);
+      push[x(a)] -= fx;
+      push[y(a)] -= fy;
+      push[x(b)] += fx;
+      push[y(b)] += fy;
+    }
+
+    // move marked inner points one by one, halving the step until no triangle around the point is inverted,
+    // hull points stay fixed as moving them could make the hull concave
+    CoordT maxdist = 0;
+    for (int e : local_edges_)
+      for (int p : { edges_.a_[e], edges_.b_[e] })
+	if (push[x(p)] != 0  ||  push[y(p)] != 0)
+	{
+	  CoordT len   = std::sqrt(push[x(p)] * push[x(p)] + push[y(p)] * push[y(p)]);
+	  CoordT scale = len > maxstep  ?  maxstep / len  :  1;
+	  CoordT oldx  = pts[x(p)], oldy = pts[y(p)];
+
+	  for (int halve = 0; halve < 4  &&  mark_[p]  &&  triangulation_.around(p, [](size_t) { }); halve++, scale *= 0.5)
+	  {
+	    pts[x(p)] = oldx + push[x(p)] * scale;
+	    pts[y(p)] = oldy + push[y(p)] * scale;
+	    bool outside = !region_->point_is_within(pts[x(p)], pts[y(p)]);
+	    if (outside)
+	      region_->move_point_back(pts[x(p)], pts[y(p)]);
+	    if (triangulation_.star_ok(pts, p))
+	    { // points moved back inside don't count for the stop condition, as in update_points()
+	      if (!outside)
+		maxdist = std::max(maxdist, (pts[x(p)] - oldx) * (pts[x(p)] - oldx) + (pts[y(p)] - oldy) * (pts[y(p)] - oldy));
+	      break;
+	    }
+	    pts[x(p)] = oldx;
+	    pts[y(p)] = oldy;
+	  }
+	  push[x(p)] = push[y(p)] = 0;
+	}
+    max_move_ = std::sqrt(maxdist) / l0_uni_;
+    converged = maxdist <= tol * tol;
+
+    if (!converged)
+      valid = legalize(maxstep, margin);
+  }
+
+  // the triangles of the relaxed layout are delaunay
+  if (valid)
+    valid = legalize(0, 0);
+  update_edges();
+  return converged  &&  valid;
+} // end Polyspring::relax_local ()
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::set_snapshot_readers (int num)
+{
+  snapshots_.resize(std::max(num, 1));
+  for (auto &snapshots : snapshots_)
+    if (!snapshots)
+      snapshots.reset(new TripleBuffer<Snapshot>);
+}
+
+// copy layout into back buffer of each reader, triangles only when changed since the buffer's last use
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::publish ()
+{
+  bool tri_ok = triangulation_.valid()  &&  !full_tri_  &&  ml_level_ < 0; // not stale from previous points, nor of a coarse level
+
+  for (auto &snapshots : snapshots_)
+  {
+    Snapshot &snap = snapshots->back();
+
+    snap.count     = count_;
+    snap.max_move  = max_move_;
+    snap.converged = converged_;
+    snap.points.resize(all_points().numpoints_ * 2);
+    all_points().get_scaled(snap.points.data());
+
+    if (!tri_ok)
+    {
+      snap.triangles.clear();
+      snap.tri_count = -1;
+    }
+    else if (snap.tri_count != triangulation_.tri_count_)
+    {
+      snap.triangles.assign(triangulation_.get_vertices().begin(), triangulation_.get_vertices().end());
+      points_.caller_indices(snap.triangles);
+      snap.tri_count = triangulation_.tri_count_;
+    }
+    snapshots->publish();
+  }
+} // end Polyspring::publish ()
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::start_solver (int every)
+{
+  stop_solver();
+  stop_ = false;
+  solving_ = true;
+  solver_ = std::thread([this, every]
+  {
+    bool keep_going = true, published = true;
+
+    while (keep_going  &&  !stop_.exchange(false))
+    {
+      keep_going = iterate();
+      published  = !keep_going  ||  count_ % std::max(every, 1) == 0;
+      if (published)
+	publish();
+    }
+    if (!published) // stopped: publish last iteration
+      publish();
+    solving_ = false;
+  });
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::stop_solver ()
+{
+  if (solver_.joinable())
+  {
+    stop_distribute();
+    solver_.join();
+    stop_ = false;
+  }
+}
+
+POLYSPRING_TEMPLATE
+long POLYSPRING_CLASS::get_allocation_count ()
+{
+#ifdef POLYSPRING_COUNT_ALLOCATIONS
+  return polyspring_allocation_count_;
+#else
+  return -1;
+#endif
+}
+
+// update edge vectors, lengths and densities of edges [begin, end) in parallel, all by default
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::update_edges (int begin, int end)
+{
+  POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::EDGES_UPDATE]));
+  end = std::min(end, edges_.numedges_);
+  pool_.parallel_for(end - begin, [&](int b, int e, int /*thread*/)
+  {
+    edges_.update(points_.points_, begin + b, begin + e);
+  });
+}
+
+// move points [begin, end) of thread, check stop condition and region, keep the thread's max squared displacement in thread_max_
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::update_points (int begin, int end, int thread)
+{
+  // second loop after all forces computation
+  /* for point in self.points:        // check stop condition if inside region, else move it back inside
+		if point.shap.within(self.region): # shap point is already pushed
+		    if exit and point.moveDist() / self.l0_uni > stop_tol: 
+			exit = False
+		else:
+		    point.moveTo(nearest_points(self.region, point.shap)[0].coords[0]) ?????
+  */
+  CoordT maxdist = thread_max_[thread];
+  char   outside[256];
+  for (int block = begin; block < end; block += 256)
+  { // per block of points: integrate, move point positions (but leave push), move points outside back inside,
+    // max displacement of points inside for stop condition: any point moved more than stop tolerance, do one more iteration
+    int blockend = std::min(block + 256, end);
+
+    integrator_.step(block, blockend, points_.push_.data());
+    points_.update(block, blockend);
+    region_->constrain(block, blockend, points_.points_.data(), outside);
+    maxdist = std::max(maxdist, points_.max_moved_inside(block, blockend, outside));
+    POLYSPRING_STAT(thread_stats_[thread].sum += points_.sum_moved_inside(block, blockend, outside, thread_stats_[thread].outside));
+#if DEBUG_POLY
+    for (int i = block; i < blockend; i++)
+      if (!outside[i - block]  &&  points_.dist_moved(i) > stop_tol_ * l0_uni_)
+	printf("iter %3d: point %d moved %f,  norm %f > stop_tol %f\n", count_, i, points_.dist_moved(i),  points_.dist_moved(i) / l0_uni_, stop_tol_);
+#endif
+  }
+  thread_max_[thread] = maxdist;
+}
+
+
+// run one phase of the current iteration, chunked phases process up to chunk points or half-edges per call,
+// returns true when the iteration is complete, keep_going is then false if converged
+POLYSPRING_TEMPLATE
+bool POLYSPRING_CLASS::iterate_phase (size_t chunk, bool &keep_going)
+{
+  // per thread in the step, in whole blocks of 256 from the thread's start so that the vectorised kernels and the blocks
+  // of update_points() and density lookups see the same groups of points and edges as in one pass
+  size_t part = std::max<size_t>(std::min<size_t>(chunk, std::numeric_limits<int>::max()) / pool_.get_num_threads(), 1);
+  part = (part + 255) / 256 * 256;
+
+  switch (phase_)
+  {
+  case PHASE_REPAIR:
+    // update triangulation if necessary
+/* 	  if update_tri:
+                tri_count += 1
+                self.delaunayTriangulation()
+                update_tri = False
+*/
+    if (update_tri_)
+    {
+      bool repaired;
+      {
+	POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::TRIANGULATE]));
+	// in incremental mode, repair triangulation locally around moved points and patch edges in place, fall back to full triangulation if that fails
+	repaired = !full_tri_  &&  incremental_tri_  &&  triangulation_.valid()  &&
+		   triangulation_.repair(points_.points_, tri_tol_ * l0_uni_, [&](size_t a, size_t b, size_t ar, size_t bl, int p0, int p1)
+					 {
+					   edges_.flip(a, b, ar, bl, p0, p1);
+					 });
+	if (!repaired)
+	{ // renumber points along a hilbert curve before a full triangulation (edges are rebuilt after), see PHASE_REORDER
+	  bool reorder = ml_level_ < 0  &&  reorder_min_points_ > 0  &&  points_.numpoints_ >= reorder_min_points_  &&
+			 (!points_.reordered()  ||  ++reorder_count_ >= reorder_interval_);
+	  phase_pos_ = 0;
+	  phase_ = reorder  ?  PHASE_REORDER  :  PHASE_SEED;
+	  return false;
+	}
+      }
+      update_edges();
+      update_tri_ = false;
+    }
+    phase_pos_ = 0;
+    phase_ = PHASE_SCALING;
+    return false;
+
+  case PHASE_REORDER:
+  { // the points, then the per-point state of the integrator
+    POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::TRIANGULATE]));
+    if (phase_pos_++ == 0)
+      points_.reorder_start();
+    else if (points_.reorder_resume(pool_, chunk))
+    {
+      integrator_.reorder(points_.reorder_permutation(), reorder_scratch_);
+      reorder_count_ = 0;
+      phase_ = PHASE_SEED;
+    }
+    return false;
+  }
+
+  case PHASE_SEED:
+  {
+    POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::TRIANGULATE]));
+    triangulation_.start(pool_, points_.get_points_interleaved());
+    phase_ = PHASE_SORT;
+    return false;
+  }
+
+  case PHASE_SORT:
+  {
+    POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::TRIANGULATE]));
+    if (triangulation_.sort(pool_))
+      phase_ = PHASE_INSERT;
+    return false;
+  }
+
+  case PHASE_INSERT:
+  {
+    POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::TRIANGULATE]));
+    if (triangulation_.insert(chunk))
+    {
+      POLYSPRING_STAT(stats_.full_triangulation = true);
+      edges_.start_set(triangulation_.get_vertices().size());	// construct unique edges list
+      phase_pos_ = 0;
+      phase_ = PHASE_EDGES;
+    }
+    return false;
+  }
+
+  case PHASE_EDGES:
+  {
+    POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::EDGES_SET]));
+    size_t numhalf = triangulation_.get_vertices().size();
+    size_t end = std::min(numhalf, phase_pos_ + std::min(chunk, numhalf));
+    edges_.add_halfedges(triangulation_.get_vertices(), triangulation_.get_halfedges(), phase_pos_, end);
+    phase_pos_ = end;
+    if (end == numhalf)
+    {
+      edges_.end_set();
+      phase_pos_ = 0;
+      phase_ = points_.reordered()  ?  PHASE_EDGES_SORT  :  PHASE_EDGES_UPDATE;
+    }
+    return false;
+  }
+
+  case PHASE_EDGES_SORT:
+  {
+    POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::EDGES_SET]));
+    if (edges_.sort(points_.numpoints_, chunk))
+      phase_ = PHASE_EDGES_UPDATE;
+    return false;
+  }
+
+  case PHASE_EDGES_UPDATE:
+  {
+    size_t end = std::min((size_t) edges_.numedges_, phase_pos_ + std::min(chunk, (size_t) edges_.numedges_));
+    update_edges(phase_pos_, end);
+    phase_pos_ = end;
+    if (end == (size_t) edges_.numedges_)
+    {
+      full_tri_ = false;
+      update_tri_ = false;
+      phase_pos_ = 0;
+      phase_ = PHASE_SCALING;
+    }
+    return false;
+  }
+
+  case PHASE_SCALING:
+  { // compute rest length scaling factor, partial sums are added in thread order (1 for uniform density)
+    hscale_ = l0_uni_;
+    if constexpr (!DensityT::uniform)
+    {
+      POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::SCALING]));
+      if (phase_pos_ == 0)
+	std::fill(thread_sum_.begin(), thread_sum_.end(), 0.);
+      bool done = pool_.parallel_for_part(edges_.numedges_, phase_pos_, part, [&](int begin, int end, int thread)
+      {
+	thread_sum_[thread] = edges_.target_area(begin, end, thread_sum_[thread]);
+      });
+      phase_pos_ += part;
+      if (!done)
+	return false;
+      hscale_ *= edges_.scaling_factor(std::accumulate(thread_sum_.begin(), thread_sum_.end(), 0.));
+    }
+    hscale_factor_ = hscale_ / l0_uni_;
+    //printf("scaling_factor %f\n", hscale_);
+    phase_pos_ = 0;
+
+    if (count_ == 0) // first iter returns pre-uniformization
+    {
+      keep_going = true;
+      return finish_iteration(keep_going);
+    }
+    phase_ = PHASE_FORCES;
+    return false;
+  }
+
+  case PHASE_FORCES:
+  {
+    // sum repulsive actions for each point
+    /* for point in self.points: 
+	for near in point.near: // each edge is visited twice, pushing each end point once: same as one visit of a unique edge pushing both end points
+	      midX ,midY = point.midTo(near)
+	      f = k * (int_pres * hscale / self.h_dist(midX, midY) - point.distTo(near))
+	      if f > 0:
+		  near.repulsiveForce(dt * f, point) // update push vector with force from near point
+    */
+
+    // calculate spring forces over precalculated edge length and relative rest length 1 / h at edges midpoints:
+    // f = k * (int_pres * hscale / h - length), if f > 0: push end points apart by dt * f along edge direction
+    POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::FORCES]));
+    POLYSPRING_STAT(if (phase_pos_ == 0) std::fill(thread_stats_.begin(), thread_stats_.end(), ThreadStats()));
+    bool done = pool_.parallel_for_part(edges_.numedges_, phase_pos_, part, [&](int begin, int end, int thread)
+    {
+      edges_.compute_forces(int_pres_ * hscale_, k_, dt_, begin, end);	// vectorised force vectors per edge
+      // update edges' end points' push vectors with force from spring, other threads than 0 write to their own push vector
+      edges_.scatter_forces(thread == 0  ?  points_.push_  :  thread_push_[thread], begin, end);
+      POLYSPRING_STAT(thread_stats_[thread].count += edges_.count_forces(begin, end, thread_stats_[thread].energy));
+    });
+    phase_pos_ += part;
+    if (!done)
+      return false;
+
+#ifdef POLYSPRING_STATS
+    for (auto &ts : thread_stats_)
+    {
+      stats_.forced_edges += ts.count;
+      stats_.energy += ts.energy;
+    }
+    stats_.energy *= 0.5 / (dt_ * dt_ * k_ * l0_uni_ * l0_uni_);	// 1/2 k compression^2, with force = dt k compression
+#endif
+    phase_pos_ = 0;
+    phase_ = pool_.get_num_threads() > 1  ?  PHASE_PUSH  :  PHASE_POINTS;
+    return false;
+  }
+
+  case PHASE_PUSH:
+  { // sum up per-thread push vectors in fixed order, and clear them for next iteration
+    POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::FORCES]));
+    bool done = pool_.parallel_for_part(points_.numpoints_ * 2, phase_pos_, part * 2, [&](int begin, int end, int /*thread*/)
+    {
+      for (int t = 1; t < (int) thread_push_.size(); t++)
+      {
+	CoordT *tpush = thread_push_[t].data();
+	for (int i = begin; i < end; i++)
+	{
+	  points_.push_[i] += tpush[i];
+	  tpush[i] = 0;
+	}
+      }
+    });
+    phase_pos_ += part * 2;
+    if (done)
+    {
+      phase_pos_ = 0;
+      phase_ = PHASE_POINTS;
+    }
+    return false;
+  }
+
+  case PHASE_POINTS:
+  {
+#if DEBUG_POLY > 2
+    if (phase_pos_ == 0)
+      vector_print("push", points_.push_);
+#endif
+
+    // MAYBE LATER: handle points which would be moved out of bounding shape:
+    // clip movement of a point A to border, but redistribute overshooting movement (perpendicular to border) as force pushing connected points Bi back from boundary (redistribute according to each point's contributions to overshoot)
+
+    // move point positions and check stop condition if inside region, else move it back inside
+    POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::POINTS]));
+    if (phase_pos_ == 0)
+    {
+      integrator_.prepare(pool_, points_.numpoints_, points_.push_.data());
+      std::fill(thread_max_.begin(), thread_max_.end(), 0);
+    }
+    bool done = pool_.parallel_for_part(points_.numpoints_, phase_pos_, part, [&](int begin, int end, int thread)
+    {
+      update_points(begin, end, thread);
+    });
+    phase_pos_ += part;
+    if (!done)
+      return false;
+
+    CoordT maxdist = *std::max_element(thread_max_.begin(), thread_max_.end());
+    CoordT tol	   = stop_tol_ * l0_uni_;
+    max_move_ = std::sqrt(maxdist) / l0_uni_;
+    moved_    = maxdist > tol * tol;
+#ifdef POLYSPRING_STATS
+    double sum = 0;
+    for (auto &ts : thread_stats_)
+    {
+      sum += ts.sum;
+      stats_.pushed_back += ts.outside;
+    }
+    stats_.max_move  = max_move_;
+    stats_.mean_move = sum / std::max(points_.numpoints_ - stats_.pushed_back, 1) / l0_uni_;
+#endif
+
+    // if live update, rescale to descr. coordinates and write to output buffers
+    //points_.get(bounds, outbuffers);
+    phase_pos_ = 0;
+    phase_ = PHASE_MOVED;
+    return false;
+  }
+
+  case PHASE_MOVED:
+  { // update edges after points have moved
+    /* NOT: for (auto e: edges_)     {
+		  e.dist_x += push_[2 * e.b]     - push_[2 * e.a];
+		  e.dist_y += push_[2 * e.b + 1] - push_[2 * e.a + 1];
+	     }  */
+    size_t end = std::min((size_t) edges_.numedges_, phase_pos_ + std::min(chunk, (size_t) edges_.numedges_));
+    update_edges(phase_pos_, end);
+    phase_pos_ = end;
+    if (end == (size_t) edges_.numedges_)
+    {
+      phase_pos_ = 0;
+      phase_ = PHASE_CHECK;
+    }
+    return false;
+  }
+
+  case PHASE_CHECK:
+  default:
+  { // check if triangulation needs to be updated: any point moved from prev_x/y more than tri_tol thresh, and set push to 0
+    {
+      POLYSPRING_STAT(StatsTimer timer(stats_.time[IterationStats::CHECK]));
+      if (phase_pos_ == 0)
+	std::fill(thread_flag_.begin(), thread_flag_.end(), 0);
+      bool done = pool_.parallel_for_part(points_.numpoints_, phase_pos_, part, [&](int begin, int end, int thread)
+      {
+	bool update = thread_flag_[thread];
+	for (int i = begin; i < end  &&  !update; i++) // todo: vectorise, mostly goes through all points
+	  update = points_.dist_since_triangulation(i, triangulation_) / l0_uni_ > tri_tol_;
+	thread_flag_[thread] = update;
+	points_.end_iteration(begin, end);
+      });
+      phase_pos_ += part;
+      if (!done)
+	return false;
+      if (std::any_of(thread_flag_.begin(), thread_flag_.end(), [](char f) { return f; }))
+	update_tri_ = true;
+    }
+
+#if DEBUG_POLY > 2
+    vector_print("final", points_.points_);
+#endif
+
+    if (!moved_) // converged: keep uniformised layout as base for attractors
+      store_uniform();
+    converged_ = !moved_;
+    keep_going = moved_;
+    return finish_iteration(keep_going);
+  }
+  }
+} // end Polyspring::iterate_phase ()
+
+// end of the current iteration: back to PHASE_REPAIR, and to the next level of the multilevel solver when the coarse one is done,
+// returns true for iterate_phase()
+POLYSPRING_TEMPLATE
+bool POLYSPRING_CLASS::finish_iteration (bool &keep_going)
+{
+  POLYSPRING_STAT(finish_stats());
+  count_++;
+  phase_pos_ = 0;
+  phase_ = PHASE_REPAIR;
+  if (ml_level_ >= 0  &&  (!keep_going  ||  (ml_level_ > 0  &&  ++ml_iter_ >= ml_refine_iter_)))
+  { // coarse level done, continue with next
+    multilevel_next();
+    keep_going = true;
+  }
+  return true;
+} // end Polyspring::finish_iteration ()
+
+// complete a spring step interrupted by the deadline of iterate_until(): its forces are partly summed in the push vectors
+// of the current points and threads, so points and threads can only change between steps
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::finish_step ()
+{
+  bool keep_going;
+  while (phase_ >= PHASE_SCALING  &&  !iterate_phase(std::numeric_limits<size_t>::max(), keep_going))
+    ;
+}
+
+
+// main loop
+POLYSPRING_TEMPLATE
+bool POLYSPRING_CLASS::iterate ()
+{
+  bool keep_going = true;
+  while (!iterate_phase(std::numeric_limits<size_t>::max(), keep_going))
+    ;
+  return keep_going;
+}
+
+POLYSPRING_TEMPLATE
+typename POLYSPRING_CLASS::Progress POLYSPRING_CLASS::iterate_until (std::chrono::steady_clock::time_point deadline)
+{
+  using clock = std::chrono::steady_clock;
+  clock::time_point now = clock::now();
+  bool keep_going = true;
+  bool first = true;
+
+  while (!converged_)
+  {
+    if (stop_.exchange(false))
+    {
+      Progress progress = get_progress();
+      progress.cancelled = true;
+      return progress;
+    }
+
+    // don't start a phase expected to overrun the deadline, or one not timed yet, but make progress in every call
+    Phase phase = phase_;
+    if (!first  &&  (phase_time_[phase] == 0  ||  now + std::chrono::duration<double>(phase_time_[phase]) > deadline))
+      break;
+
+    iterate_phase(std::max<size_t>(chunk_size_, 1), keep_going);
+
+    // expected duration is a slowly decaying maximum, to rather stop early than overrun
+    clock::time_point prev = now;
+    now = clock::now();
+    phase_time_[phase] = std::max(std::chrono::duration<double>(now - prev).count(), 0.95 * phase_time_[phase]);
+    first = false;
+  }
+  return get_progress();
+} // end Polyspring::iterate_until ()
+
+
+// complete stats of current iteration, and keep them in history
+POLYSPRING_TEMPLATE
+void POLYSPRING_CLASS::finish_stats ()
+{
+  stats_.iteration = count_;
+  stats_.numedges  = edges_.numedges_;
+  stats_.flips     = triangulation_.flip_count_ - stats_flips_;
+  stats_flips_     = triangulation_.flip_count_;
+  last_stats_ = stats_;
+
+  if (!stats_history_.empty())
+  {
+    stats_history_[stats_next_] = stats_;
+    stats_next_  = (stats_next_ + 1) % stats_history_.size();
+    stats_count_ = std::min<int>(stats_count_ + 1, stats_history_.size());
+  }
+  stats_ = IterationStats();
+} // end Polyspring::finish_stats ()
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Batch of views
+
+// independent layouts of one corpus for several descriptor column pairs (views), e.g. to precompute all views for instant switching:
+// the columns used by any view are gathered once from the caller's blocks into a compact row-major table,
+// then the pool's threads take unsolved views one at a time from a shared counter (so that long and short solves balance out;
+// views are coarse tasks, so one atomic increment per view does what per-thread queues with work stealing would),
+// solve each single-threaded until converged, and deliver it by callback from the solving thread
+template<typename CoordT, typename RegionT = Region<CoordT>, typename DensityT = MapDensity<CoordT>, typename IntegratorT = EulerIntegrator<CoordT>>
+class PolyspringBatch
+{
+public:
+  using Solver	 = Polyspring<CoordT, RegionT, DensityT, IntegratorT>;
+  using Callback = std::function<void (int view, Solver &solver)>;
+
+private:
+  int			numpoints_ = 0;
+  int			numcols_ = 0;	// distinct columns used by the views
+  std::vector<CoordT>	table_;		// row-major numpoints_ x numcols_
+  std::vector<int>	view_cols_;	// interleaved x/y column of each view in table_
+  std::vector<std::unique_ptr<Solver>> solvers_;
+  std::unique_ptr<std::atomic<bool>[]> solved_;
+  std::atomic<int>	next_{0};	// next view to take
+  std::atomic<bool>	stop_{false};
+  std::atomic<bool>	running_{false};
+  ThreadPool		pool_;
+  std::thread		thread_;	// background batch
+
+  void solve_views (const Callback &done, int max_iter);
+
+public:
+  PolyspringBatch () {}
+  ~PolyspringBatch () { stop(); }
+
+  void set_num_threads (int num) { pool_.set_num_threads(num); }	// views solved in parallel, 0 = hardware concurrency, not while running
+
+  // gather the columns of numviews views, given as interleaved colx, coly in cols, from blocks (layout as for Polyspring::set_points),
+  // and create a solver per view; solved views are reset (not while running)
+  void set_points (int numtotal, int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int numviews, const int cols[]);
+
+  int	  get_num_views () { return (int) solvers_.size(); }
+  Solver &get_solver (int view) { return *solvers_[view]; }	// set region, density, parameters before solving, get results once solved
+  bool	  is_solved (int view) { return solved_[view]; }	// thread-safe
+
+  // solve the unsolved views, each until converged or max_iter iterations (0 = no limit), calling done(view, solver) as each one is solved
+  void solve (Callback done = Callback(), int max_iter = 0);	// returns when all are solved or stopped
+  void start (Callback done = Callback(), int max_iter = 0);	// same in a background thread, no other method but is_solved() until stop()
+  void stop ();		// stop and join the background batch, views being solved stay unsolved and are restarted by the next solve()
+  bool running () { return running_; }
+}; // end class PolyspringBatch
+
+#define POLYSPRING_BATCH_CLASS PolyspringBatch<CoordT, RegionT, DensityT, IntegratorT>
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_BATCH_CLASS::set_points (int numtotal, int numbuffers, int bufsizes[], CoordT *buffers[], int bufwidth, int numviews, const int cols[])
+{
+  // distinct columns, in order of first use
+  std::vector<int> used;
+  view_cols_.resize(numviews * 2);
+  for (int i = 0; i < numviews * 2; i++)
+  {
+    auto found = std::find(used.begin(), used.end(), cols[i]);
+    view_cols_[i] = found - used.begin();
+    if (found == used.end())
+      used.push_back(cols[i]);
+  }
+  numpoints_ = numtotal;
+  numcols_   = used.size();
+
+  // one pass over the rows of the blocks
+  table_.resize((size_t) numtotal * numcols_);
+  blockwise(numbuffers, bufsizes, buffers,
+	    [&](int bufsize, CoordT *buffer, int offset) -> void
+	    {
+	      for (int row = 0; row < bufsize; row++)
+		for (int c = 0; c < numcols_; c++)
+		  table_[(size_t) (offset + row) * numcols_ + c] = buffer[(size_t) row * bufwidth + used[c]];
+	    });
+
+  solvers_.resize(numviews);
+  for (auto &solver : solvers_)
+    if (!solver)
+      solver.reset(new Solver);
+  solved_.reset(new std::atomic<bool>[numviews]);
+  for (int v = 0; v < numviews; v++)
+    solved_[v] = false;
+} // end PolyspringBatch::set_points ()
+
+// run on all pool threads: take the next unsolved view until none is left
+POLYSPRING_TEMPLATE
+void POLYSPRING_BATCH_CLASS::solve_views (const Callback &done, int max_iter)
+{
+  next_ = 0;
+  pool_.run([&](int thread, int numthreads)
+  {
+    for (int v = next_++; v < get_num_views()  &&  !stop_; v = next_++)
+    {
+      if (solved_[v])
+	continue;
+
+      Solver &solver = *solvers_[v];
+      CoordT *table  = table_.data();
+      int     num    = numpoints_;
+
+      solver.set_points(num, 1, &num, &table, numcols_, view_cols_[x(v)], view_cols_[y(v)]);
+      while (!stop_  &&  solver.iterate()  &&  (max_iter <= 0  ||  solver.get_count() < max_iter))
+	;
+      if (stop_)
+	break;
+
+      solver.publish();
+      solved_[v] = true;
+      if (done)
+	done(v, solver);
+    }
+  });
+} // end PolyspringBatch::solve_views ()
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_BATCH_CLASS::solve (Callback done, int max_iter)
+{
+  stop_ = false;
+  running_ = true;
+  solve_views(done, max_iter);
+  running_ = false;
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_BATCH_CLASS::start (Callback done, int max_iter)
+{
+  stop();
+  running_ = true;
+  thread_ = std::thread([this, done, max_iter]
+  {
+    solve_views(done, max_iter);
+    running_ = false;
+  });
+}
+
+POLYSPRING_TEMPLATE
+void POLYSPRING_BATCH_CLASS::stop ()
+{
+  if (thread_.joinable())
+  {
+    stop_ = true;
+    thread_.join();
+  }
+  stop_ = false;
+}
@@ -0,0 +1,683 @@
+/* -*-mode:c; c-basic-offset: 2-*- */
+/* polyspring OSC server: drop-in replacement of Python/polyspring-osc.py for Max/polyspring.maxpat,
+   solving with the C++ Polyspring on a worker thread
+
+   build with cmake (see ../CMakeLists.txt), or:
+   c++ -std=c++17 -O3 -march=native -pthread -I .. polyspring-server.cpp -o polyspring-server
+
+   polyspring-server [options]
+     --host address	host to send to (default 127.0.0.1)
+     --port n		port to send to (default 8012)
+     --listen n		port to receive on (default 8011)
+     --threads n	solver threads, 0 = hardware concurrency (default 0)
+     --rate n		max layout bytes per second sent, 0 = unpaced (default 0);
+			set it when a slow receiver drops packets of large corpora
+     --verbose		print each received message
+
+   protocol (as polyspring-osc.py), received:
+     /export_init numbuffers batchsize		start an import, replies /begin_import 1; drops the corpus until the next /set_cols
+     /add_buffer numrows name numcols		replies /start_dump 1
+     /add_line d0 d1 ... index name		one row, replies /next_batch 1 every batchsize rows of a buffer,
+						/next_buffer 1 when a buffer is complete, /done_import 1 after the last
+     /set_cols xcol ycol, /write_track xcol ycol	set corpus columns: /buffer_index, /clear, /append per row, /bounds, /done_init 1, /update 1;
+						keeps region and density (polyspring-osc.py resets them with its corpus)
+     /distribute					solve from the pre-uniformisation, streaming layout updates (see polyspring-osc.hpp), /update 1 when done
+     /interpolation t				export the layout mixed with the original positions
+     /region x0 y0 x1 y1 ...			polygon in normalised coordinates, y pointing down
+     /density expression			relative density h(x, y), e.g. "1 + 3 * x" (arithmetic, ** or ^, sqrt, exp, log, sin, cos, ...)
+     /attractors mx my sigx sigy theta ...	gaussian attractors displacing the layout, other argument counts reset
+     /stop					stop distribute, answered while solving
+     /get_bounds				replies /bounds xmin xmax ymin ymax
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "polyspring-osc.hpp"
+#include "polyspring.hpp"
+
+using Solver = Polyspring<float, Region<float>, MapDensity<float>>;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// density expressions
+
+// arithmetic expression in x and y, compiled to a stack program:
+// numbers, x, y, pi, e, + - * / ** ^ (power), unary minus, parentheses, functions of one argument, pow/min/max of two,
+// optional np. or math. prefixes as in python
+class Expression
+{
+  enum Op { PUSH, X, Y, ADD, SUB, MUL, DIV, POW, NEG, MIN, MAX, FUNC };
+  struct Instr { Op op; double value = 0; double (*func)(double) = NULL; };
+
+  std::vector<Instr> code_;
+  const char	    *pos_ = NULL;
+  std::string	     error_;
+
+  void skip () { while (isspace((unsigned char) *pos_)) pos_++; }
+
+  bool accept (const char *token)
+  {
+    skip();
+    size_t len = strlen(token);
+    if (strncmp(pos_, token, len) != 0)
+      return false;
+    pos_ += len;
+    return true;
+  }
+
+  void fail (const std::string &msg) { if (error_.empty()) error_ = msg + " at '" + pos_ + "'"; }
+
+  // sum := product { (+|-) product }
+  void sum ()
+  {
+    product();
+    while (error_.empty())
+      if (accept("+"))
+	product(), code_.push_back({ ADD });
+      else if (accept("-"))
+	product(), code_.push_back({ SUB });
+      else
+	return;
+  }
+
+  // product := unary { (*|/) unary }
+  void product ()
+  {
+    unary();
+    while (error_.empty())
+    {
+      skip();
+      if (pos_[0] == '*'  &&  pos_[1] != '*')
+	pos_++, unary(), code_.push_back({ MUL });
+      else if (accept("/"))
+	unary(), code_.push_back({ DIV });
+      else
+	return;
+    }
+  }
+
+  // unary := - unary | power
+  void unary ()
+  {
+    if (accept("-"))
+      unary(), code_.push_back({ NEG });
+    else if (accept("+"))
+      unary();
+    else
+      power();
+  }
+
+  // power := primary [ (**|^) unary ]   (right associative, binds tighter than unary minus on its left as in python)
+  void power ()
+  {
+    primary();
+    if (accept("**")  ||  accept("^"))
+      unary(), code_.push_back({ POW });
+  }
+
+  void primary ()
+  {
+    skip();
+    if (accept("("))
+    {
+      sum();
+      if (!accept(")"))
+	fail("missing )");
+      return;
+    }
+    if (isdigit((unsigned char) *pos_)  ||  *pos_ == '.')
+    {
+      char *end;
+      double value = strtod(pos_, &end);
+      pos_ = end;
+      code_.push_back({ PUSH, value });
+      return;
+    }
+
+    std::string name;
+    while (isalnum((unsigned char) *pos_)  ||  *pos_ == '_'  ||  *pos_ == '.')
+      name += *pos_++;
+    for (const char *prefix : { "np.", "numpy.", "math." })
+      if (name.compare(0, strlen(prefix), prefix) == 0)
+	name.erase(0, strlen(prefix));
+
+    if (name == "x")
+      code_.push_back({ X });
+    else if (name == "y")
+      code_.push_back({ Y });
+    else if (name == "pi")
+      code_.push_back({ PUSH, M_PI });
+    else if (name == "e")
+      code_.push_back({ PUSH, M_E });
+    else if (name == "pow"  ||  name == "min"  ||  name == "max"  ||  name == "minimum"  ||  name == "maximum")
+    { // two arguments
+      if (!accept("("))
+	return fail("missing (");
+      sum();
+      if (!accept(","))
+	return fail("missing ,");
+      sum();
+      if (!accept(")"))
+	return fail("missing )");
+      code_.push_back({ name == "pow"  ?  POW  :  name[1] == 'i'  ?  MIN  :  MAX });
+    }
+    else
+    {
+      static const std::map<std::string, double (*)(double)> functions =
+      {
+	{ "sqrt", sqrt }, { "exp", exp }, { "log", log }, { "log10", log10 }, { "abs", fabs }, { "fabs", fabs },
+	{ "sin", sin }, { "cos", cos }, { "tan", tan }, { "tanh", tanh }, { "floor", floor }, { "ceil", ceil }
+      };
+      auto func = functions.find(name);
+      if (func == functions.end())
+	return fail("unknown name '" + name + "'");
+      if (!accept("("))
+	return fail("missing (");
+      sum();
+      if (!accept(")"))
+	return fail("missing )");
+      code_.push_back({ FUNC, 0, func->second });
+    }
+  } // end Expression::primary ()
+
+public:
+  // returns false and sets error() if text is not a valid expression
+  bool compile (const std::string &text)
+  {
+    code_.clear();
+    error_.clear();
+    pos_ = text.c_str();
+    sum();
+    skip();
+    if (*pos_)
+      fail("unexpected");
+    return error_.empty();
+  }
+
+  const std::string &error () { return error_; }
+
+  double operator() (double x, double y) const
+  {
+    double stack[64];
+    int    top = 0;
+    for (const Instr &in : code_)
+    {
+      if (top >= 63)
+	return NAN;
+      switch (in.op)
+      {
+      case PUSH: stack[top++] = in.value; break;
+      case X:	 stack[top++] = x; break;
+      case Y:	 stack[top++] = y; break;
+      case NEG:	 stack[top - 1] = -stack[top - 1]; break;
+      case FUNC: stack[top - 1] = in.func(stack[top - 1]); break;
+      case ADD:	 top--, stack[top - 1] += stack[top]; break;
+      case SUB:	 top--, stack[top - 1] -= stack[top]; break;
+      case MUL:	 top--, stack[top - 1] *= stack[top]; break;
+      case DIV:	 top--, stack[top - 1] /= stack[top]; break;
+      case POW:	 top--, stack[top - 1] = pow(stack[top - 1], stack[top]); break;
+      case MIN:	 top--, stack[top - 1] = std::min(stack[top - 1], stack[top]); break;
+      case MAX:	 top--, stack[top - 1] = std::max(stack[top - 1], stack[top]); break;
+      }
+    }
+    return top == 1  ?  stack[0]  :  NAN;
+  }
+}; // end class Expression
+
+
+///////////////////////////////////////////////////////////////////////////////
+// server
+
+struct Options
+{
+  std::string host = "127.0.0.1";
+  std::string port = "8012";
+  std::string listen = "8011";
+  int	      threads = 0;
+  double      rate = 0;
+  bool	      verbose = false;
+};
+
+class Server
+{
+  struct Buffer
+  {
+    std::string	       name;
+    int		       numrows = 0, numcols = 0, received = 0;
+    std::vector<float> rows;	// row-major numrows x numcols descriptors
+  };
+
+  // layout as a LayoutStreamer frame
+  struct Frame
+  {
+    int			count = 0;
+    bool		converged = false;
+    std::vector<float>	points;
+    std::vector<size_t> triangles;
+    int			tri_count = -1;
+  };
+
+  Options	      opt_;
+  UdpSocket	      in_, out_;
+  OscReader	      reader_;
+  OscWriter	      writer_;
+  LayoutStreamer      stream_;
+  Solver	      solver_;
+  Frame		      frame_;
+
+  // import
+  std::vector<Buffer> buffers_;	// in order of /add_buffer
+  int		      expected_buffers_ = 0;
+  int		      batch_size_ = 1;
+
+  // corpus
+  bool		      has_corpus_ = false;
+  int		      xcol_ = 0, ycol_ = 1;
+  std::vector<int>    bufsizes_, bufindices_;
+  std::vector<float *> bufptrs_;
+  int		      numpoints_ = 0;
+  float		      interp_ = 0;
+  bool		      solving_ = false;
+  Expression	      density_;
+
+  Buffer *find_buffer (const std::string &name)
+  {
+    for (Buffer &b : buffers_)
+      if (b.name == name)
+	return &b;
+    return NULL;
+  }
+
+  void send (const char *address, int value)
+  {
+    writer_.begin_message(address, "i");
+    writer_.add_int(value);
+    out_.send(writer_.data(), writer_.size());
+  }
+
+  void send_bounds ()
+  {
+    std::vector<float> bmin, brange;
+    solver_.get_bounds(bmin, brange);
+    writer_.begin_message("/bounds", "ffff");
+    writer_.add_float(bmin[0]);
+    writer_.add_float(bmin[0] + brange[0]);
+    writer_.add_float(bmin[1]);
+    writer_.add_float(bmin[1] + brange[1]);
+    out_.send(writer_.data(), writer_.size());
+  }
+
+  // stop a running distribute before changing the solver
+  void stop_solving ()
+  {
+    if (solving_)
+    {
+      solver_.stop_solver();
+      finish_distribute();
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // import
+
+  void export_init (const std::vector<OscArg> &args)
+  {
+    if (args.size() < 2)
+      return;
+    stop_solving();
+    printf("--> Export from Max...\n");
+    clear_corpus();
+    buffers_.clear();
+    expected_buffers_ = args[0].i;
+    batch_size_	      = std::max<int>(1, args[1].i);
+    send("/begin_import", 1);
+  }
+
+  void add_buffer (const std::vector<OscArg> &args)
+  {
+    if (args.size() < 3)
+      return;
+    stop_solving();
+    clear_corpus();	// the rows of a resent buffer are reallocated
+    Buffer *b = find_buffer(args[1].text());
+    if (!b)
+    {
+      buffers_.emplace_back();
+      b = &buffers_.back();
+    }
+    b->name	= args[1].text();
+    b->numrows	= std::max<int>(0, args[0].i);
+    b->numcols	= std::max<int>(1, args[2].i + 1);
+    b->received = 0;
+    b->rows.assign((size_t) b->numrows * b->numcols, 0);
+    send("/start_dump", 1);
+  }
+
+  void add_line (const std::vector<OscArg> &args)
+  {
+    if (args.size() < 2)
+      return;
+    Buffer *b	  = find_buffer(args.back().text());
+    int	    index = args[args.size() - 2].i;
+    if (!b  ||  index < 0  ||  index >= b->numrows)
+      return;
+
+    int    num = std::min<int>(args.size() - 2, b->numcols);
+    float *row = &b->rows[(size_t) index * b->numcols];
+    for (int c = 0; c < num; c++)
+      row[c] = args[c].f;
+    b->received++;
+
+    if (b->received == b->numrows)
+    {
+      printf("buffer %s, %d grains\n", b->name.c_str(), b->received);
+      send("/next_buffer", 1);
+      bool all = (int) buffers_.size() == expected_buffers_;
+      for (Buffer &other : buffers_)
+	all = all  &&  other.received >= other.numrows;
+      if (all)
+	send("/done_import", 1);
+    }
+    if (b->received % batch_size_ == 0)
+      send("/next_batch", 1);
+  }
+
+  // set corpus columns, echo the corpus to Max
+  void set_cols (const std::vector<OscArg> &args)
+  {
+    if (args.size() < 2  ||  buffers_.empty())
+      return;
+    stop_solving();
+    printf("--- change columns to %d %d\n", (int) args[0].i, (int) args[1].i);
+    xcol_ = args[0].i;
+    ycol_ = args[1].i;
+
+    // blocks of the corpus for set_points, as columns of the imported rows (all buffers share the smallest width)
+    int width = buffers_[0].numcols;
+    for (Buffer &b : buffers_)
+      width = std::min(width, b.numcols);
+    if (xcol_ < 0  ||  ycol_ < 0  ||  xcol_ >= width  ||  ycol_ >= width)
+    {
+      printf("ERROR: columns %d %d out of range 0..%d\n", xcol_, ycol_, width - 1);
+      return;
+    }
+    repack(width);
+
+    // echo rows as /append timetag x y x y, batched in bundles
+    OscWriter bundle;
+    for (size_t k = 0; k < buffers_.size(); k++)
+    {
+      send("/buffer_index", bufindices_[k]);
+      send("/clear", 1);
+      for (int i = 0; i < bufsizes_[k]; i++)
+      {
+	const float *row = bufptrs_[k] + (size_t) i * width;
+	if (bundle.size() == 0)
+	  bundle.begin_bundle();
+	bundle.begin_message("/append", "fffff");
+	bundle.add_float(row[0]);
+	bundle.add_float(row[xcol_]);
+	bundle.add_float(row[ycol_]);
+	bundle.add_float(row[xcol_]);
+	bundle.add_float(row[ycol_]);
+	bundle.end_message();
+	if (bundle.size() + OscWriter::message_size(strlen("/append"), 5) > stream_.mtu_  ||  i == bufsizes_[k] - 1)
+	{
+	  out_.send(bundle.data(), bundle.size());
+	  bundle.clear();
+	}
+      }
+    }
+
+    solver_.set_points(numpoints_, bufptrs_.size(), bufsizes_.data(), bufptrs_.data(), width, xcol_, ycol_);
+    stream_.set_buffers(bufsizes_.size(), bufsizes_.data(), bufindices_.data());
+    has_corpus_ = true;
+
+    send_bounds();
+    send("/done_init", 1);
+    send("/update", 1);
+    printf("<-- Done\n");
+  } // end Server::set_cols ()
+
+  // forget the corpus blocks pointing into the imported rows, until the next /set_cols
+  void clear_corpus ()
+  {
+    has_corpus_ = false;
+    bufsizes_.clear();
+    bufindices_.clear();
+    bufptrs_.clear();
+    numpoints_ = 0;
+  }
+
+  // rows of all buffers to the common width, such that each buffer is one set_points() block
+  void repack (int width)
+  {
+    bufsizes_.clear();
+    bufindices_.clear();
+    bufptrs_.clear();
+    numpoints_ = 0;
+    for (Buffer &b : buffers_)
+    {
+      if (b.numcols != width)
+      {
+	for (int i = 0; i < b.numrows; i++)
+	  std::copy_n(&b.rows[(size_t) i * b.numcols], width, &b.rows[(size_t) i * width]);
+	b.numcols = width;
+	b.rows.resize((size_t) b.numrows * width);
+      }
+      bufsizes_.push_back(b.numrows);
+      bufindices_.push_back(atoi(b.name.c_str()));
+      bufptrs_.push_back(b.rows.data());
+      numpoints_ += b.numrows;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // solving
+
+  void distribute ()
+  {
+    if (!has_corpus_  ||  numpoints_ < 3)
+      return;
+    stop_solving();
+    printf("--> Distributing...\n");
+    // from the pre-uniformisation, as polyspring-osc.py
+    solver_.set_points(numpoints_, bufptrs_.size(), bufsizes_.data(), bufptrs_.data(), buffers_[0].numcols, xcol_, ycol_);
+    stream_.reset();
+    solver_.start_solver();
+    stream_.start(solver_);
+    solving_ = true;
+  }
+
+  // called when the solver thread ended: final export
+  void finish_distribute ()
+  {
+    solver_.stop_solver();
+    stream_.stop();
+    solving_ = false;
+    Solver::Progress progress = solver_.get_progress();
+    export_layout(interp_);
+    if (progress.converged)
+      printf("<-- Done (%d steps, %d triangulations)\n", progress.count, solver_.get_triangulation_count());
+    else
+      printf("<-- Force Stop (%d steps, %d triangulations)\n", progress.count, solver_.get_triangulation_count());
+    send("/update", 1);
+  }
+
+  // send all points (mixed with the original positions by interp) and triangles
+  void export_layout (float interp)
+  {
+    if (!has_corpus_)
+      return;
+    float *out = NULL;
+    frame_.points.resize(numpoints_ * 2);
+    out = frame_.points.data();
+    solver_.get_points(1, &numpoints_, &out, 2, 0, 1, interp);
+    solver_.get_vertices(frame_.triangles);
+    frame_.count     = solver_.get_count();
+    frame_.converged = false;
+    frame_.tri_count = solver_.get_triangulation_count();
+    stream_.reset();
+    stream_.send_frame(frame_);
+  }
+
+  void interpolation (const std::vector<OscArg> &args)
+  {
+    if (args.empty())
+      return;
+    interp_ = args[0].f;
+    if (!solving_)
+      export_layout(interp_);
+  }
+
+  void region (const std::vector<OscArg> &args)
+  {
+    if (args.size() < 6)
+      return;
+    stop_solving();
+    printf("--- change region\n");
+    std::vector<float> coords;
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+      coords.push_back(args[i].f);
+      coords.push_back(1 - args[i + 1].f);
+    }
+    int numvertices = coords.size() / 2;
+    solver_.set_region(1, &numvertices, coords.data());
+  }
+
+  void density (const std::vector<OscArg> &args)
+  {
+    if (args.empty())
+      return;
+    stop_solving();
+    std::string text;
+    for (const OscArg &arg : args)	// Max may split the expression into atoms
+      text += (text.empty()  ?  ""  :  " ") + arg.text();
+    printf("--- change density %s\n", text.c_str());
+    if (!density_.compile(text))
+    {
+      printf("ERROR: density: %s\n", density_.error().c_str());
+      return;
+    }
+    solver_.set_density_function(128, 128, [this](float x, float y) { return (float) density_(x, y); });
+  }
+
+  void attractors (const std::vector<OscArg> &args)
+  {
+    if (!has_corpus_)
+      return;
+    stop_solving();
+    std::vector<float> params;
+    if (args.size() % 5 == 0)
+      for (const OscArg &arg : args)
+	params.push_back(arg.f);
+    solver_.set_attractors(params.size() / 5, params.data());
+    export_layout(interp_);
+  }
+
+public:
+  Server (const Options &opt) : opt_(opt)
+  {
+    solver_.set_num_threads(opt.threads);
+    stream_.byte_rate_ = opt.rate;
+    stream_.send_update_ = false;	// finish_distribute() sends /update after the final export, converged or stopped
+  }
+
+  bool open ()
+  {
+    if (!in_.bind(NULL, opt_.listen.c_str()))
+    {
+      printf("ERROR: can't listen on port %s\n", opt_.listen.c_str());
+      return false;
+    }
+    if (!out_.open(opt_.host.c_str(), opt_.port.c_str())  ||  !stream_.open(opt_.host.c_str(), opt_.port.c_str()))
+    {
+      printf("ERROR: can't send to %s:%s\n", opt_.host.c_str(), opt_.port.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  void handle (const char *address, const std::vector<OscArg> &args)
+  {
+    if (opt_.verbose)
+    {
+      printf("%s", address);
+      for (const OscArg &arg : args)
+	printf(" %s", arg.text().c_str());
+      printf("\n");
+    }
+
+    std::string a = address;
+    if (a == "/add_line")	   add_line(args);	// most frequent first
+    else if (a == "/stop")	   solver_.stop_distribute();
+    else if (a == "/export_init")  export_init(args);
+    else if (a == "/add_buffer")   add_buffer(args);
+    else if (a == "/set_cols"  ||  a == "/write_track")  set_cols(args);
+    else if (a == "/distribute")   distribute();
+    else if (a == "/interpolation") interpolation(args);
+    else if (a == "/region")	   region(args);
+    else if (a == "/density")	   density(args);
+    else if (a == "/attractors")   attractors(args);
+    else if (a == "/get_bounds")   { if (has_corpus_) send_bounds(); }
+    else if (opt_.verbose)	   printf("unknown message %s\n", address);
+  }
+
+  // serve until quit is set: the solver runs in its own thread, such that messages (e.g. /stop) are handled while solving
+  void run (volatile sig_atomic_t &quit)
+  {
+    std::vector<char> packet(65536);
+    printf("----- Serving on port %s, sending to %s:%s\n", opt_.listen.c_str(), opt_.host.c_str(), opt_.port.c_str());
+    while (!quit)
+    {
+      int size = in_.receive(packet.data(), packet.size(), 20);
+      if (size > 0  &&  !reader_.parse(packet.data(), size, [this](const char *address, const std::vector<OscArg> &args) { handle(address, args); }))
+	printf("ERROR: malformed OSC packet of %d bytes\n", size);
+      if (solving_  &&  !solver_.solver_running())
+	finish_distribute();
+    }
+    stop_solving();
+  }
+}; // end class Server
+
+
+static volatile sig_atomic_t quit = 0;
+
+int main (int argc, char *argv[])
+{
+  Options opt;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    const char *val = i + 1 < argc  ?  argv[i + 1]  :  "";
+    if (arg == "--host")		opt.host = val, i++;
+    else if (arg == "--port")		opt.port = val, i++;
+    else if (arg == "--listen")		opt.listen = val, i++;
+    else if (arg == "--threads")	opt.threads = atoi(val), i++;
+    else if (arg == "--rate")		opt.rate = atof(val), i++;
+    else if (arg == "--verbose")	opt.verbose = true;
+    else
+    {
+      fprintf(stderr, "usage: %s [--host address] [--port n] [--listen n] [--threads n] [--rate n] [--verbose]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  signal(SIGINT, [](int) { quit = 1; });
+  signal(SIGTERM, [](int) { quit = 1; });
+
+  Server server(opt);
+  if (!server.open())
+    return 1;
+  server.run(quit);
+  return 0;
+}
@@ -0,0 +1,288 @@
+"""Protocol test of polyspring-server: plays the part of Max/polyspring.maxpat and checks the replies.
+
+Covers the import flow control (/export_init, /add_buffer, /add_line), /set_cols, /distribute (to convergence and
+interrupted by /stop), /region, /density, /attractors and /interpolation, and that the server survives a /distribute
+without a corpus and a malformed density. Only needs the python standard library.
+
+    python3 test-client.py --server build/polyspring-server     (starts and stops the server)
+    python3 test-client.py                                        (server already running on the default ports)
+
+Exits with status 1 if any check fails.
+"""
+
+from argparse import ArgumentParser
+import os
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+
+# ---- OSC encoding and decoding (int, float, string arguments, bundles)
+def pad(data):
+    return data + b'\0' * (4 - len(data) % 4)
+
+def encode(address, *args):
+    tags = ','
+    data = b''
+    for arg in args:
+        if isinstance(arg, int):
+            tags += 'i'
+            data += struct.pack('>i', arg)
+        elif isinstance(arg, float):
+            tags += 'f'
+            data += struct.pack('>f', arg)
+        else:
+            tags += 's'
+            data += pad(str(arg).encode())
+    return pad(address.encode()) + pad(tags.encode()) + data
+
+def decode(packet, messages):
+    if packet.startswith(b'#bundle\0'):
+        pos = 16
+        while pos < len(packet):
+            size = struct.unpack('>i', packet[pos:pos + 4])[0]
+            decode(packet[pos + 4:pos + 4 + size], messages)
+            pos += 4 + size
+        return
+    address = packet[:packet.index(b'\0')].decode()
+    pos = (len(address) + 4) & ~3
+    tags = packet[pos:packet.index(b'\0', pos)].decode()
+    pos += (len(tags) + 4) & ~3
+    args = []
+    for tag in tags[1:]:
+        if tag == 'i':
+            args.append(struct.unpack('>i', packet[pos:pos + 4])[0])
+            pos += 4
+        elif tag == 'f':
+            args.append(struct.unpack('>f', packet[pos:pos + 4])[0])
+            pos += 4
+        elif tag == 's':
+            end = packet.index(b'\0', pos)
+            args.append(packet[pos:end].decode())
+            pos = (end + 4) & ~3
+    messages.append((address, args))
+
+
+class Client:
+    def __init__(self, host, port, listen):
+        self.server = (host, port)
+        self.tx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.rx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.rx.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 8 << 20)
+        self.rx.bind(('127.0.0.1', listen))
+
+    def send(self, address, *args):
+        self.tx.sendto(encode(address, *args), self.server)
+
+    def receive(self, until=None, timeout=60.0, quiet=0.3):
+        """messages until one with address until arrives (or timeout), or until quiet seconds pass without any"""
+        messages = []
+        start = time.time()
+        self.rx.settimeout(0.05)
+        last = time.time()
+        while time.time() - start < timeout:
+            try:
+                decode(self.rx.recv(65536), messages)
+                last = time.time()
+            except socket.timeout:
+                if until is None and time.time() - last > quiet:
+                    break
+                continue
+            if until is not None and messages and messages[-1][0] == until:
+                break
+        return messages
+
+
+# ---- checks
+failures = []
+
+def check(name, ok, detail=''):
+    print('%-50s %s %s' % (name, 'ok' if ok else 'FAILED', detail))
+    if not ok:
+        failures.append(name)
+
+def count(messages, address):
+    return sum(1 for a, _ in messages if a == address)
+
+def layout(messages, sizes):
+    """layout rows per buffer index from the /buffer_index, /matrixcol, /set_matrix messages, last values win"""
+    points = {index: [[None, None] for _ in range(size)] for index, size in sizes.items()}
+    buffer = col = None
+    for address, args in messages:
+        if address == '/buffer_index':
+            buffer = args[0]
+        elif address == '/matrixcol':
+            col = args[0]
+        elif address == '/set_matrix' and buffer in points and col in (2, 3):
+            for k, value in enumerate(args[1:]):
+                points[buffer][args[0] + k][col - 2] = value
+    return points
+
+def inside(polygon, x, y, tol):
+    """point within tol of the inside of a convex polygon with counter-clockwise vertices"""
+    for (x0, y0), (x1, y1) in zip(polygon, polygon[1:] + polygon[:1]):
+        length = ((x1 - x0) ** 2 + (y1 - y0) ** 2) ** 0.5
+        if ((x1 - x0) * (y - y0) - (y1 - y0) * (x - x0)) / length < -tol:
+            return False
+    return True
+
+
+def distribute(client):
+    """/distribute to the end: returns the messages up to /update and the seconds it took"""
+    start = time.time()
+    client.send('/distribute')
+    messages = client.receive('/update', timeout=120)
+    return messages, time.time() - start
+
+def run(client, rows, batch):
+    half = len(rows) // 2
+    buffers = {'1': rows[:half], '2': rows[half:]}
+    sizes = {int(name): len(buffer) for name, buffer in buffers.items()}
+    numpoints = len(rows)
+
+    # import, flow controlled as polyspring.maxpat: a batch of rows after each /next_batch
+    client.send('/export_init', len(buffers), batch)
+    check('/export_init replies /begin_import', count(client.receive('/begin_import', 5), '/begin_import') == 1)
+    replies = []
+    for name, buffer in buffers.items():
+        client.send('/add_buffer', len(buffer), name, len(buffer[0]) - 1)
+        check('/add_buffer %s replies /start_dump' % name, count(client.receive('/start_dump', 5), '/start_dump') == 1)
+        for start in range(0, len(buffer), batch):
+            for i in range(start, min(start + batch, len(buffer))):
+                client.send('/add_line', *buffer[i], i, name)
+            if start + batch <= len(buffer):
+                got = client.receive('/next_batch', 5)
+                replies += got
+                if count(got, '/next_batch') != 1:
+                    break
+        replies += client.receive()
+    expected = sum(len(buffer) // batch for buffer in buffers.values())
+    check('import: /next_batch per batch', count(replies, '/next_batch') == expected, '(%d of %d)' % (count(replies, '/next_batch'), expected))
+    check('import: /next_buffer per buffer', count(replies, '/next_buffer') == len(buffers))
+    check('import: /done_import after the last row', count(replies, '/done_import') == 1  and  replies[-1][0] in ('/done_import', '/next_batch'))
+
+    # no corpus until /set_cols: /distribute must be ignored
+    client.send('/distribute')
+    check('/distribute before /set_cols is ignored', client.receive(quiet=1) == [])
+
+    # columns: echo of the corpus
+    client.send('/set_cols', 1, 2)
+    messages = client.receive('/update', 10)
+    check('/set_cols echoes every row as /append', count(messages, '/append') == numpoints, '(%d)' % count(messages, '/append'))
+    check('/set_cols replies /bounds, /done_init, /update',
+          count(messages, '/bounds') == 1  and  count(messages, '/done_init') == 1  and  messages[-1][0] == '/update')
+
+    bounds = [args for address, args in messages if address == '/bounds'][0]
+    def normalised(points):
+        """layout in the unit square of the corpus bounds (xmin xmax ymin ymax), as the patch displays it"""
+        return [((x - bounds[0]) / (bounds[1] - bounds[0]), (y - bounds[2]) / (bounds[3] - bounds[2]))
+                for buffer in points.values() for x, y in buffer if x is not None  and  y is not None]
+
+    # interrupted distribute
+    client.send('/distribute')
+    start = time.time()
+    client.send('/stop')
+    messages = client.receive('/update', 10)
+    latency = time.time() - start
+    messages += client.receive()
+    check('/stop ends /distribute with one /update', count(messages, '/update') == 1  and  latency < 1, '(%.3f s)' % latency)
+
+    # distribute to convergence: streamed layout, triangles, a single /update
+    messages, seconds = distribute(client)
+    messages += client.receive()
+    points = layout(messages, sizes)
+    complete = all(x is not None  and  y is not None for buffer in points.values() for x, y in buffer)
+    check('/distribute streams the layout of every point', complete, '(%.2f s, %d messages)' % (seconds, len(messages)))
+    check('/distribute sends triangles', count(messages, '/tri') + count(messages, '/tri_part') > 0)
+    updates = [count(messages, '/update')]
+    for _ in range(9):	# the streamer and the final export used to race to send /update
+        updates.append(count(distribute(client)[0] + client.receive(), '/update'))
+    check('/distribute ends with one /update', updates == [1] * len(updates), str(updates))
+
+    # interpolation 1: the original positions
+    client.send('/interpolation', 1.0)
+    original = layout(client.receive(), sizes)
+    xs = [x for buffer in original.values() for x, _ in buffer]
+    lo, hi = min(r[1] for r in rows), max(r[1] for r in rows)
+    check('/interpolation 1 exports the original positions', abs(min(xs) - lo) < 1e-3 * (hi - lo)  and  abs(max(xs) - hi) < 1e-3 * (hi - lo))
+    client.send('/interpolation', 0.0)
+    client.receive()
+
+    # region: a triangle, y pointing down as sent by the patch
+    client.send('/region', 0.0, 0.0, 1.0, 0.0, 0.5, 1.0)
+    client.receive()
+    messages, seconds = distribute(client)
+    points = normalised(layout(messages + client.receive(), sizes))
+    triangle = [(0.0, 1.0), (0.5, 0.0), (1.0, 1.0)]	# the region in normalised layout coordinates, counter-clockwise
+    outside = numpoints - sum(1 for x, y in points if inside(triangle, x, y, 0.01))
+    check('/region: the layout fills the triangle', outside == 0, '(%d of %d points outside, %.2f s)' % (outside, numpoints, seconds))
+    client.send('/set_cols', 1, 2)
+    client.receive('/update', 10)
+    messages, seconds = distribute(client)
+    points = normalised(layout(messages + client.receive(), sizes))
+    outside = numpoints - sum(1 for x, y in points if inside(triangle, x, y, 0.01))
+    check('/set_cols keeps the region', outside == 0, '(%d of %d points outside)' % (outside, numpoints))
+
+    # density: up to four times as dense on the right, in the unit square
+    client.send('/region', 0.0, 0.0, 1.0, 0.0, 1.0, 1.0, 0.0, 1.0)
+    client.send('/density', '1 + 3 * x')
+    client.receive()
+    messages, seconds = distribute(client)
+    points = layout(messages + client.receive(), sizes)
+    right = sum(1 for x, _ in normalised(points) if x > 0.5) / numpoints
+    check('/density 1 + 3 * x: most points on the right', right > 0.6, '(%.0f%%, %.2f s)' % (100 * right, seconds))
+
+    # attractors displace the exported layout, other argument counts reset
+    client.send('/attractors', 0.5, 0.5, 0.1, 0.1, 0.0)
+    moved = layout(client.receive(), sizes)
+    client.send('/attractors')
+    restored = layout(client.receive(), sizes)
+    def difference(a, b):
+        return max(abs(p[k] - q[k]) for index in a for p, q in zip(a[index], b[index]) for k in (0, 1)
+                   if None not in p  and  None not in q)
+    check('/attractors displace the layout', complete  and  difference(moved, points) > 0.01, '(max %.3f)' % difference(moved, points))
+    check('/attractors without parameters reset', difference(restored, points) < 1e-3, '(max %.3g)' % difference(restored, points))
+
+    # errors don't stop the server
+    client.send('/density', '1 +* x')
+    client.send('/get_bounds')
+    check('malformed /density leaves the server running', count(client.receive('/bounds', 5), '/bounds') == 1)
+
+    # a new import drops the corpus: nothing to distribute until /set_cols
+    client.send('/export_init', 1, batch)
+    client.receive('/begin_import', 5)
+    client.send('/distribute')
+    client.send('/get_bounds')
+    check('/export_init drops the corpus', client.receive(quiet=1) == [])
+
+
+if __name__ == '__main__':
+    parser = ArgumentParser()
+    parser.add_argument('--server', help='server executable to start, else connect to a running one')
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=8011, help='port the server listens on')
+    parser.add_argument('--listen', type=int, default=8012, help='port the server sends to')
+    parser.add_argument('--data', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), '../../test-data/truth-2.txt'))
+    parser.add_argument('--batch', type=int, default=50)
+    args = parser.parse_args()
+
+    rows = [[float(v) for v in line.split()] for line in open(args.data) if line.strip()]
+    client = Client(args.host, args.port, args.listen)
+
+    server = None
+    if args.server:
+        server = subprocess.Popen([args.server, '--port', str(args.listen), '--listen', str(args.port)], stdout=subprocess.DEVNULL)
+        time.sleep(0.5)
+    try:
+        run(client, rows, args.batch)
+        if server:
+            check('server still running', server.poll() is None)
+    finally:
+        if server:
+            server.terminate()
+            server.wait()
+
+    print('FAILED: %s' % ', '.join(failures) if failures else 'OK')
+    sys.exit(1 if failures else 0)
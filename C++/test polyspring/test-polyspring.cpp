@@ -1,16 +1,15 @@
 /* -*-mode:c; c-basic-offset: 2-*- */
 /* compile and run with:
-   c++ -std=c++17 -g -fsanitize=address -fno-omit-frame-pointer -I /sw/include -I .. -I ../delaunator-cpp/include/ -L/sw/lib -llo test-polyspring.cpp && ./a.out
+   c++ -std=c++17 -g -fsanitize=address -fno-omit-frame-pointer -I /sw/include -I .. -L/sw/lib -llo test-polyspring.cpp && ./a.out
  */
 
 #include "stdio.h"
 #include "unistd.h"	// sleep
 #include "time.h"	// clock
 #include "lo/lo.h"	// osc
-#include <fstream>
-#include <iterator>
 #include <vector>
-#include "polyspring.hpp"
+#include "polyspring-io.hpp"
+#include "polyspring-osc.hpp"
 
 lo_address addr;
 
@@ -72,27 +71,6 @@ void osc_send_buffer (int bufind, int numrows, float *buffer, float *orig, int w
   }
 }
 
-void osc_send_tri (std::vector<size_t> &vertices)
-{
-  int stat = 0;
-  int numv = vertices.size();
-  lo_message msg = lo_message_new();
-
-    for (int i = 0; i < numv; i++)
-  {
-    lo_message_add_int32(msg, vertices[i]);
-  }
-
-  stat += lo_send_message(addr, "/tri", msg);
-
-  if (stat < 0)
-  {
-    printf("osc_send_tri status %d, error %d '%s'\n", stat, lo_address_errno(addr), lo_address_errstr(addr));
-  }
-
-  lo_message_free(msg);
-}
-
 int data_gen_linear (int bufsize, float **bufs, int &width, int &xcol, int &ycol)
 {
   float *buffer = (float *) malloc(bufsize * 2 * sizeof(float)); // memleak, but we don't care
@@ -113,21 +91,24 @@ int data_gen_linear (int bufsize, float **bufs, int &width, int &xcol, int &ycol
 
 int data_load (const char *filename, float **bufs, int &width, int &xcol, int &ycol)
 {
-  std::ifstream file(filename);
-  if (file.fail())
+  static ThreadPool	     pool;
+  static std::vector<float> data;
+  TextCorpus<float> corpus;
+  pool.set_num_threads(0);
+  if (!corpus.load(filename, pool))
   {
-    printf("ERROR: can't open %s.\n", filename);
+    printf("ERROR: can't read %s.\n", filename);
     return -1;
   }
-  
-  static std::vector<float> vec(std::istream_iterator<float>(file), {});
 
   // columns in txt files : timetags | original x | original y | final x | final y
-  bufs[0] = vec.data();
+  for (auto &rows : corpus.chunks_)	// one buffer, as sent to Max
+    data.insert(data.end(), rows.begin(), rows.end());
+  bufs[0] = data.data();
   width = 5;
   xcol = 1;
   ycol = 2;
-  return vec.size() / 5;
+  return corpus.numrows_;
 }
 
 int main (int argc, char *argv[])
@@ -155,20 +136,28 @@ int main (int argc, char *argv[])
   osc_send_buffer(1, bufsize, poly.points_.get_points_interleaved(true).data(), buffer, width, xcol, ycol);
   print_points("set", bufsize, poly.points_.get_points_interleaved(true).data());
 
+  // layout updates: moved points and changed triangles only, in MTU-sized bundles
+  LayoutStreamer stream;
+  stream.open("127.0.0.1", "8012");
+  stream.tri_max_size_ = 65507;	// polyspring-test.maxpat routes /tri only
+
   bool keepgoing;
   const int numiter = 100;
+  const long budget = 20000;	// solve for at most 20 ms per 100 ms tick
   do
   {
     clock_t start_iter = clock();
-    keepgoing = poly.iterate()  &&  poly.get_count() < numiter;
+    Polyspring<float>::Progress progress = poly.iterate_for(budget);
+    keepgoing = !progress.converged  &&  progress.count < numiter;
     clock_t stop_iter = clock();
     float dur = (stop_iter - start_iter) / (float) CLOCKS_PER_SEC * 1000.;
   
     printf("iter %d  tri %d  go %d\n", poly.get_count(), poly.get_triangulation_count(), keepgoing);
-    osc_send_buffer(1, bufsize, poly.points_.get_points_interleaved(true).data(), buffer, width, xcol, ycol);
+    poly.publish();
+    size_t bytes = stream.send_frame(poly.get_snapshot());
     //print_points("", bufsize, poly.points_.get_points_interleaved(true).data());
-    osc_send_tri(poly.triangulation_.get_vertices());
-    printf("iter %d  tri %d  go %d took %f ms\n", poly.get_count(), poly.get_triangulation_count(), keepgoing, dur);
+    printf("sent %zu bytes\n", bytes);
+    printf("iter %d  tri %d  go %d  max move %f took %f ms\n", poly.get_count(), poly.get_triangulation_count(), keepgoing, progress.max_move, dur);
 
     usleep(std::max(0., (100 - dur) * 1000.));
   } while (keepgoing);
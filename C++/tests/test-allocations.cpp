@@ -0,0 +1,72 @@
+/* -*-mode:c; c-basic-offset: 2-*- */
+/* check that iterating doesn't allocate once the solver is warmed up (full and incremental triangulation, float and double,
+   1 to 4 threads), on a gaussian corpus whose dense center makes the flip stacks grow
+
+   test-allocations [numpoints]
+   exits with status 1 if any configuration allocates after warm-up */
+
+#define POLYSPRING_COUNT_ALLOCATIONS
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <new>
+#include "polyspring.hpp"
+
+// counting replacement of the global operator new, one definition per program
+void *operator new (size_t size)
+{
+  polyspring_allocation_count_++;
+  if (void *ptr = malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+void *operator new[] (size_t size) { return operator new(size); }
+void operator delete (void *ptr) noexcept { free(ptr); }
+void operator delete[] (void *ptr) noexcept { free(ptr); }
+void operator delete (void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[] (void *ptr, size_t) noexcept { free(ptr); }
+
+template<typename CoordT>
+static bool check (int numpoints, int numthreads, bool incremental)
+{
+  std::mt19937 rng(1);
+  std::normal_distribution<double> normal(0.5, 0.15);
+  std::vector<CoordT> data(numpoints * 2);
+  for (auto &v : data)
+    v = normal(rng);
+
+  CoordT *buffers[1] = { data.data() };
+  Polyspring<CoordT> poly;
+  poly.set_num_threads(numthreads);
+  poly.set_incremental_triangulation(incremental);
+  poly.set_points(numpoints, 1, &numpoints, buffers, 2, 0, 1);
+
+  for (int i = 0; i < 20; i++)	// warm-up: buffers reach their size
+    poly.iterate();
+
+  long allocs = Polyspring<CoordT>::get_allocation_count();
+  int  tris   = poly.get_triangulation_count();
+  while (poly.iterate()  &&  poly.get_count() < 2000)
+    ;
+  allocs = Polyspring<CoordT>::get_allocation_count() - allocs;
+
+  printf("%-6s %d threads %-11s: %4d iterations, %4d triangulations, %ld allocations\n", sizeof(CoordT) == 4  ?  "float"  :  "double",
+	 numthreads, incremental  ?  "incremental"  :  "full", poly.get_count(), poly.get_triangulation_count() - tris, allocs);
+  return allocs == 0;
+}
+
+int main (int argc, char *argv[])
+{
+  int  numpoints = argc > 1  ?  atoi(argv[1])  :  5000;
+  bool ok = true;
+
+  for (int threads : { 1, 2, 4 })
+    for (bool incremental : { false, true })
+    {
+      ok &= check<float>(numpoints, threads, incremental);
+      ok &= check<double>(numpoints, threads, incremental);
+    }
+
+  printf(ok  ?  "OK\n"  :  "FAILED: allocations after warm-up\n");
+  return ok  ?  0  :  1;
+}
@@ -0,0 +1,52 @@
+/* -*-mode:c; c-basic-offset: 2-*- */
+/* check that iterate_for() returns by its deadline on a large corpus: the spring step is chunked like the triangulation, so no call
+   may overrun by more than a chunk; the triangulation is kept after the first one (tri_tol_ out of reach) to measure the steps
+
+   test-deadline [numpoints [budget_us]]
+   exits with status 1 if calls overrun or make no progress */
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include "polyspring.hpp"
+
+int main (int argc, char *argv[])
+{
+  int  numpoints = argc > 1  ?  atoi(argv[1])  :  300000;
+  long budget	 = argc > 2  ?  atol(argv[2])  :  5000;	// microseconds, below the duration of one step of numpoints
+  const int numcalls = 100;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniform;
+  std::vector<float> data(numpoints * 2);
+  for (auto &v : data)
+    v = uniform(rng);
+
+  float *buffers[1] = { data.data() };
+  Polyspring<float> poly;
+  poly.set_points(numpoints, 1, &numpoints, buffers, 2, 0, 1);
+  poly.tri_tol_ = 1e9;
+  poly.iterate();	// triangulation
+  poly.iterate();	// first step, times the phases
+
+  std::vector<double> overrun;	// ms past the deadline, negative if early
+  int count = poly.get_count();
+  for (int i = 0; i < numcalls; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    poly.iterate_for(budget);
+    overrun.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() - budget * 1e-3);
+  }
+  count = poly.get_count() - count;
+
+  // a call may be preempted (by far more than the budget on one core), hence the tolerance for the maximum, which is only reported;
+  // an unchunked phase would overrun once per iteration, every few calls
+  std::sort(overrun.begin(), overrun.end());
+  double p95 = overrun[numcalls * 95 / 100], p99 = overrun[numcalls * 99 / 100 - 1], max = overrun.back();
+  bool	 ok  = count > 0  &&  p95 <= 1  &&  p99 <= budget * 1e-3;
+  printf("%d points, %d calls of %ld us: %d iterations, overrun 95th percentile %.2f ms, 99th %.2f ms, max %.2f ms: %s\n",
+	 numpoints, numcalls, budget, count, p95, p99, max, ok  ?  "OK"  :  "FAILED");
+  return ok  ?  0  :  1;
+}
@@ -0,0 +1,61 @@
+/* -*-mode:c; c-basic-offset: 2-*- */
+/* check that a converged layout stays converged after a small corpus update: add_points() and remove_points() keep the rest length and
+   relax only the neighbourhood of the points added or removed, so that few or no full iterations follow (relaxing all points took
+   about 1200 iterations on 3000 points after adding 100)
+
+   test-incremental [numpoints [numchange [maxiter]]]
+   exits with status 1 if the layout needs more than maxiter iterations to reconverge after a change */
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "polyspring.hpp"
+
+// iterations until converged, at most limit + 1
+static int reconverge (Polyspring<float> &poly, int limit)
+{
+  int count = poly.get_count();
+  while (!poly.get_progress().converged  &&  poly.get_count() - count <= limit)
+    poly.iterate();
+  return poly.get_count() - count;
+}
+
+int main (int argc, char *argv[])
+{
+  int numpoints = argc > 1  ?  atoi(argv[1])  :  3000;
+  int numchange = argc > 2  ?  atoi(argv[2])  :  100;
+  int maxiter	= argc > 3  ?  atoi(argv[3])  :  100;
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> uniform;
+  std::vector<float> data((numpoints + numchange) * 2);
+  for (auto &v : data)
+    v = uniform(rng);
+
+  float *buffers[1] = { data.data() };
+  Polyspring<float> poly;
+  poly.set_incremental_triangulation(true);
+  poly.set_points(numpoints, 1, &numpoints, buffers, 2, 0, 1);
+  while (poly.iterate())
+    ;
+  int	 initial = poly.get_count();
+  double l0	 = poly.l0_uni_;
+
+  float *added[1] = { data.data() + numpoints * 2 };
+  poly.add_points(1, &numchange, added, 2, 0, 1);
+  bool	 kept  = poly.get_progress().converged  &&  poly.l0_uni_ == l0;
+  int	 niter = reconverge(poly, maxiter);
+
+  // the points just added, as points on the hull can't be removed locally
+  std::vector<int> removed(numchange);
+  for (int i = 0; i < numchange; i++)
+    removed[i] = numpoints + i;
+  poly.remove_points(numchange, removed.data());
+  kept &= poly.get_progress().converged  &&  poly.l0_uni_ == l0;
+  int riter = reconverge(poly, maxiter);
+
+  bool ok = kept  &&  poly.get_num_points() == numpoints  &&  niter <= maxiter  &&  riter <= maxiter;
+  printf("%d points converged in %d iterations; added %d: reconverged in %d iterations, removed %d: in %d iterations (at most %d),"
+	 " rest length %s: %s\n", numpoints, initial, numchange, niter, numchange, riter, maxiter, kept  ?  "kept"  :  "changed", ok  ?  "OK"  :  "FAILED");
+  return ok  ?  0  :  1;
+}
@@ -0,0 +1,162 @@
+/* -*-mode:c; c-basic-offset: 2-*- */
+/* stream a converging layout with LayoutStreamer to a local receiver, which decodes the bundles with OscReader and rebuilds the layout
+   and the triangles: a small corpus must get its triangles as one /tri message (as routed by Max/polyspring-test.maxpat), a large one
+   as /tri_part chunks, or as one /tri message up to tri_max_size_; the rebuilt layout must match the last snapshot within the streamer's threshold, the triangles exactly
+
+   test-osc-stream [port]
+   exits with status 1 if any check fails */
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include "polyspring.hpp"
+#include "polyspring-osc.hpp"
+
+struct Receiver
+{
+  UdpSocket sock;
+  OscReader reader;
+  std::map<int, std::vector<float>> cols[2];	// layout x and y by buffer index
+  std::vector<size_t> triangles;
+  int  buffer = 0, col = 0;
+  long packets = 0, tri = 0, tri_part = 0, steps = 0, updates = 0, unknown = 0, malformed = 0;
+
+  void message (const char *address, const std::vector<OscArg> &args)
+  {
+    std::string addr = address;
+    if (addr == "/buffer_index")
+      buffer = args[0].i;
+    else if (addr == "/matrixcol")
+      col = args[0].i;
+    else if (addr == "/set_matrix")
+    {
+      auto &v = cols[col == 3][buffer];
+      size_t row = args[0].i;
+      if (v.size() < row + args.size() - 1)
+	v.resize(row + args.size() - 1);
+      for (size_t i = 1; i < args.size(); i++)
+	v[row + i - 1] = args[i].f;
+    }
+    else if (addr == "/tri")
+    {
+      triangles.resize(args.size());
+      for (size_t i = 0; i < args.size(); i++)
+	triangles[i] = args[i].i;
+      tri++;
+    }
+    else if (addr == "/tri_part")
+    {
+      triangles.resize(args[1].i);
+      for (size_t i = 2; i < args.size(); i++)
+	triangles[args[0].i + i - 2] = args[i].i;
+      tri_part++;
+    }
+    else if (addr == "/step")
+      steps++;
+    else if (addr == "/update")
+      updates++;
+    else
+      unknown++;
+  }
+
+  // until timeout_ms pass without a datagram
+  void drain (int timeout_ms)
+  {
+    std::vector<char> buf(65536);
+    int size;
+    while ((size = sock.receive(buf.data(), buf.size(), timeout_ms)) > 0)
+    {
+      packets++;
+      if (!reader.parse(buf.data(), size, [this](const char *address, const std::vector<OscArg> &args) { message(address, args); }))
+	malformed++;
+    }
+  }
+};
+
+static bool check (const char *port, int numpoints, bool single_tri, size_t tri_max_size = 0)
+{
+  Receiver rcv;
+  if (!rcv.sock.bind("127.0.0.1", port))
+  {
+    printf("can't bind port %s\n", port);
+    return false;
+  }
+  std::atomic<bool> quit{false};
+  std::thread receiver([&] { while (!quit) rcv.drain(50); });
+
+  // two buffers of uniform points
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniform;
+  std::vector<float> data(numpoints * 2);
+  for (auto &v : data)
+    v = uniform(rng);
+  int	 sizes[2]   = { numpoints / 3, numpoints - numpoints / 3 }, indices[2] = { 7, 9 };
+  float *buffers[2] = { data.data(), data.data() + sizes[0] * 2 };
+
+  Polyspring<float> poly;
+  poly.stop_tol_ = 0.01;
+  poly.set_points(numpoints, 2, sizes, buffers, 2, 0, 1);
+
+  LayoutStreamer stream;
+  stream.byte_rate_ = 20e6;	// no drops on loopback
+  stream.tri_max_size_ = tri_max_size;
+  if (!stream.open("127.0.0.1", port))
+    return false;
+  stream.set_buffers(2, sizes, indices);
+
+  bool running;
+  do
+  {
+    running = poly.iterate()  &&  poly.get_count() < 5000;
+    poly.publish();
+    stream.send_frame(poly.get_snapshot());
+  } while (running);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  quit = true;
+  receiver.join();
+  rcv.drain(50);
+
+  // rebuilt layout against the last snapshot
+  auto  &snap = poly.get_snapshot();
+  float  lo[2] = { INFINITY, INFINITY }, hi[2] = { -INFINITY, -INFINITY };
+  for (size_t i = 0; i < snap.points.size(); i++)
+  {
+    lo[i & 1] = std::min(lo[i & 1], snap.points[i]);
+    hi[i & 1] = std::max(hi[i & 1], snap.points[i]);
+  }
+  double tolerance = 2 * stream.threshold_ * std::max(hi[0] - lo[0], hi[1] - lo[1]), maxerr = 0;
+  bool	 complete = true;
+  for (int b = 0, start = 0; b < 2; start += sizes[b], b++)
+  {
+    auto &x = rcv.cols[0][indices[b]], &y = rcv.cols[1][indices[b]];
+    if ((int) x.size() != sizes[b]  ||  (int) y.size() != sizes[b])
+    {
+      complete = false;
+      continue;
+    }
+    for (int i = 0; i < sizes[b]; i++)
+      maxerr = std::max<double>(maxerr, std::max(std::fabs(x[i] - snap.points[(start + i) * 2]), std::fabs(y[i] - snap.points[(start + i) * 2 + 1])));
+  }
+
+  auto &stats = stream.get_stats();
+  bool ok = complete  &&  maxerr <= tolerance  &&  rcv.triangles == snap.triangles  &&  snap.converged  &&  rcv.updates == 1
+    &&  rcv.packets == stats.packets  &&  rcv.malformed == 0  &&  rcv.unknown == 0  &&  (single_tri  ?  rcv.tri_part == 0  :  rcv.tri == 0);
+  printf("%5d points: %4d iterations, converged %d, %ld packets (%ld received, %ld malformed), %ld bytes, /tri %ld, /tri_part %ld, /update %ld,"
+	 " %zu triangles %s, max error %g (tolerance %g): %s\n",
+	 numpoints, snap.count, snap.converged, stats.packets, rcv.packets, rcv.malformed, stats.bytes, rcv.tri, rcv.tri_part, rcv.updates,
+	 snap.triangles.size() / 3, rcv.triangles == snap.triangles  ?  "equal"  :  "differ", maxerr, tolerance, ok  ?  "ok"  :  "FAILED");
+  return ok;
+}
+
+int main (int argc, char *argv[])
+{
+  const char *port = argc > 1  ?  argv[1]  :  "9312";
+  bool ok = check(port, 40, true);	// 61 triangles fit into one datagram
+  ok &= check(port, 5000, false);
+  ok &= check(port, 1500, true, 65507);	// 2900 triangles, 44 kB
+
+  printf(ok  ?  "OK\n"  :  "FAILED\n");
+  return ok  ?  0  :  1;
+}